@@ -0,0 +1,208 @@
+/*
+ * attrib.c - Attributes misses and evictions to matrix elements
+ *
+ * tracegen writes .addrmap, one line per array:
+ *      <name> <base address in hex> <rows> <cols> <element size>
+ *  With csim -A .addrmap every miss is charged to the element that was
+ *  accessed and every eviction to the first element of the evicted block.
+ *  Each eviction also counts against the pair (evicted block, incoming
+ *  block), both named by their first element, so tiles of A and B that
+ *  keep knocking each other out show up at the top of the pair list.
+ *
+ * Per-element counts go to .csim_missmap: for each array a header line
+ *  "<name> <rows> <cols> misses" followed by one line of counts per row,
+ *  then the same again for evictions.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Reads an address map sidecar.
+ *
+ * Params: file name.
+ * Returns: the map, or NULL if the file can't be read.
+ */
+AddressMap * loadAddressMap(const char * mapFile) {
+    char name[ARRAY_NAME_MAX];
+    unsigned long long base;
+    int rows, cols, elemSize;
+    AddressMap * map;
+    FILE * fp = fopen(mapFile, "r");
+
+    if(!fp) {
+        printf("Can't open address map\n");
+        return NULL;
+    }
+    map = calloc(1, sizeof(*map));
+    if(map == NULL) {
+        printf("Out of memory in loadAddressMap\n");
+        exit(-1);
+    }
+    while(map->count < MAX_MAPPED_ARRAYS &&
+          fscanf(fp, "%15s %llx %d %d %d", name, &base, &rows, &cols, &elemSize) == 5) {
+        MappedArray * a = &map->arrays[map->count];
+        if(rows <= 0 || cols <= 0 || elemSize <= 0) {
+            continue;
+        }
+        strcpy(a->name, name);
+        a->base = base;
+        a->rows = rows;
+        a->cols = cols;
+        a->elemSize = elemSize;
+        a->misses = calloc((size_t)rows * cols, sizeof(unsigned long));
+        a->evictions = calloc((size_t)rows * cols, sizeof(unsigned long));
+        if(a->misses == NULL || a->evictions == NULL) {
+            printf("Out of memory in loadAddressMap\n");
+            exit(-1);
+        }
+        map->count++;
+    }
+    fclose(fp);
+    blockMapInit(&map->pairs, 1024);
+    return map;
+}
+
+void freeAddressMap(AddressMap * map) {
+    int i;
+    if(map == NULL) return;
+    for(i = 0; i < map->count; i++) {
+        free(map->arrays[i].misses);
+        free(map->arrays[i].evictions);
+    }
+    blockMapFree(&map->pairs);
+    free(map);
+}
+
+/*
+ * Finds the first array element in [start, start + length).
+ *
+ * Returns: (array index << 28) | element index, or -1 if no array overlaps.
+ */
+static int64_t findElement(AddressMap * map, uint64_t start, uint64_t length) {
+    int i;
+    for(i = 0; i < map->count; i++) {
+        MappedArray * a = &map->arrays[i];
+        uint64_t end = a->base + (uint64_t)a->rows * a->cols * a->elemSize;
+        if(start < end && start + length > a->base) {
+            uint64_t first = start > a->base ? start : a->base;
+            return ((int64_t)i << 28) | (int64_t)((first - a->base) / a->elemSize);
+        }
+    }
+    return -1;
+}
+
+static void formatElement(AddressMap * map, int64_t id, char * buf, size_t size) {
+    MappedArray * a = &map->arrays[id >> 28];
+    int index = (int)(id & ((1 << 28) - 1));
+    snprintf(buf, size, "%s[%d][%d]", a->name, index / a->cols, index % a->cols);
+}
+
+/*
+ * Charges the outcome of one access to array elements.
+ *
+ * Params: address map, cache the access went to, address, ACCESS_* result.
+ */
+void attributeAccess(AddressMap * map, Cache * cache, uint64_t address, int result) {
+    int64_t element, victim, incoming;
+    if(result & ACCESS_MISS) {
+        element = findElement(map, address, 1);
+        if(element == -1) map->otherMisses++;
+        else map->arrays[element >> 28].misses[element & ((1 << 28) - 1)]++;
+    }
+    if(result & ACCESS_EVICT) {
+        uint64_t blockStart = address & ~(uint64_t)(cache->blockSize - 1);
+        victim = findElement(map, cache->lastVictim << cache->numBlockBits, cache->blockSize);
+        if(victim == -1) {
+            map->otherEvictions++;
+            return;
+        }
+        map->arrays[victim >> 28].evictions[victim & ((1 << 28) - 1)]++;
+        incoming = findElement(map, blockStart, cache->blockSize);
+        if(incoming != -1) {
+            //unordered pair, so A evicting B and B evicting A add up
+            uint64_t lo = victim < incoming ? victim : incoming;
+            uint64_t hi = victim < incoming ? incoming : victim;
+            (*blockMapInsert(&map->pairs, (hi << 32) | lo, NULL))++;
+        }
+    }
+}
+
+static int comparePairs(const void * x, const void * y) {
+    const size_t * a = x;
+    const size_t * b = y;
+    //entries are (count, slot); larger counts first
+    if(a[0] != b[0]) return a[0] < b[0] ? 1 : -1;
+    return a[1] < b[1] ? -1 : 1;
+}
+
+static void writeGrid(FILE * fp, MappedArray * a, unsigned long * counts, const char * what) {
+    int r, c;
+    fprintf(fp, "%s %d %d %s\n", a->name, a->rows, a->cols, what);
+    for(r = 0; r < a->rows; r++) {
+        for(c = 0; c < a->cols; c++) {
+            fprintf(fp, c ? " %lu" : "%lu", counts[(size_t)r * a->cols + c]);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+/*
+ * Prints per-array totals and the element pairs with the most evictions
+ *  between them (every pair when verbose), and writes .csim_missmap.
+ */
+void printAttribution(AddressMap * map, int verbose) {
+    size_t i, n = 0, shown;
+    size_t * order;
+    int a;
+    FILE * fp;
+
+    for(a = 0; a < map->count; a++) {
+        MappedArray * arr = &map->arrays[a];
+        unsigned long misses = 0, evictions = 0;
+        size_t e;
+        for(e = 0; e < (size_t)arr->rows * arr->cols; e++) {
+            misses += arr->misses[e];
+            evictions += arr->evictions[e];
+        }
+        printf("array %s (%dx%d at %lx): misses:%lu evictions:%lu\n", arr->name, arr->rows,
+               arr->cols, (unsigned long)arr->base, misses, evictions);
+    }
+    printf("outside arrays: misses:%lu evictions:%lu\n", map->otherMisses, map->otherEvictions);
+
+    order = malloc((map->pairs.count + 1) * 2 * sizeof(size_t));
+    if(order == NULL) {
+        printf("Out of memory in printAttribution\n");
+        exit(-1);
+    }
+    for(i = 0; i < map->pairs.capacity; i++) {
+        if(map->pairs.used[i]) {
+            order[2 * n] = map->pairs.values[i];
+            order[2 * n + 1] = i;
+            n++;
+        }
+    }
+    qsort(order, n, 2 * sizeof(size_t), comparePairs);
+    shown = verbose || n < TOP_EVICTION_PAIRS ? n : TOP_EVICTION_PAIRS;
+    if(n > 0) printf("eviction pairs (%lu total, most frequent first):\n", (unsigned long)n);
+    for(i = 0; i < shown; i++) {
+        uint64_t key = map->pairs.keys[order[2 * i + 1]];
+        char x[64], y[64];
+        formatElement(map, (int64_t)(key & 0xffffffffULL), x, sizeof(x));
+        formatElement(map, (int64_t)(key >> 32), y, sizeof(y));
+        printf("  %s <-> %s: %lu\n", x, y, (unsigned long)order[2 * i]);
+    }
+    free(order);
+
+    fp = fopen(".csim_missmap", "w");
+    if(!fp) {
+        printf("Can't write .csim_missmap\n");
+        return;
+    }
+    for(a = 0; a < map->count; a++) {
+        writeGrid(fp, &map->arrays[a], map->arrays[a].misses, "misses");
+        writeGrid(fp, &map->arrays[a], map->arrays[a].evictions, "evictions");
+    }
+    fclose(fp);
+}
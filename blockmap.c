@@ -0,0 +1,117 @@
+/*
+ * blockmap.c - Open addressing hash map keyed by block address
+ *
+ * Used by the simulator modules that need per-block bookkeeping for
+ *  blocks that are no longer (or never were) resident in a cache.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static size_t hashBlock(uint64_t key, size_t capacity) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key & (capacity - 1);
+}
+
+static void * checkedCalloc(size_t count, size_t size) {
+    void * p = calloc(count, size);
+    if(p == NULL) {
+        printf("Out of memory in blockmap\n");
+        exit(-1);
+    }
+    return p;
+}
+
+/*
+ * Sets up an empty map. Capacity is rounded up to a power of two.
+ *
+ * Params: map pointer, expected number of entries.
+ */
+void blockMapInit(BlockMap * map, size_t capacity) {
+    size_t cap = 16;
+    while(cap < capacity * 2) {
+        cap <<= 1;
+    }
+    map->capacity = cap;
+    map->count = 0;
+    map->keys = checkedCalloc(cap, sizeof(uint64_t));
+    map->values = checkedCalloc(cap, sizeof(size_t));
+    map->used = checkedCalloc(cap, 1);
+}
+
+void blockMapFree(BlockMap * map) {
+    free(map->keys);
+    free(map->values);
+    free(map->used);
+    map->keys = NULL;
+    map->values = NULL;
+    map->used = NULL;
+    map->capacity = 0;
+    map->count = 0;
+}
+
+static void blockMapGrow(BlockMap * map) {
+    size_t i;
+    BlockMap bigger;
+    blockMapInit(&bigger, map->capacity);
+    for(i = 0; i < map->capacity; i++) {
+        if(map->used[i]) {
+            size_t j = hashBlock(map->keys[i], bigger.capacity);
+            while(bigger.used[j]) {
+                j = (j + 1) & (bigger.capacity - 1);
+            }
+            bigger.used[j] = 1;
+            bigger.keys[j] = map->keys[i];
+            bigger.values[j] = map->values[i];
+            bigger.count++;
+        }
+    }
+    blockMapFree(map);
+    *map = bigger;
+}
+
+/*
+ * Looks up a block.
+ *
+ * Returns: pointer to the stored value, or NULL if the key is absent.
+ *          The pointer is only valid until the next insert.
+ */
+size_t * blockMapFind(BlockMap * map, uint64_t key) {
+    size_t i = hashBlock(key, map->capacity);
+    while(map->used[i]) {
+        if(map->keys[i] == key) {
+            return &map->values[i];
+        }
+        i = (i + 1) & (map->capacity - 1);
+    }
+    return NULL;
+}
+
+/*
+ * Looks up a block, adding it with a value of 0 if it is not present.
+ *
+ * Params: map pointer, key, created is set to 1 if the key was new (may be NULL).
+ * Returns: pointer to the stored value, valid until the next insert.
+ */
+size_t * blockMapInsert(BlockMap * map, uint64_t key, int * created) {
+    size_t i;
+    if((map->count + 1) * 10 > map->capacity * 7) {
+        blockMapGrow(map);
+    }
+    i = hashBlock(key, map->capacity);
+    while(map->used[i]) {
+        if(map->keys[i] == key) {
+            if(created) *created = 0;
+            return &map->values[i];
+        }
+        i = (i + 1) & (map->capacity - 1);
+    }
+    map->used[i] = 1;
+    map->keys[i] = key;
+    map->values[i] = 0;
+    map->count++;
+    if(created) *created = 1;
+    return &map->values[i];
+}
@@ -27,6 +27,9 @@ void printSummary(int hits,  /* number of  hits */
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 
+/* Fill a single matrix with random data */
+void randMatrix(int M, int N, int A[N][M]);
+
 /* The baseline trans function that produces correct results. */
 void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 
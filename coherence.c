@@ -0,0 +1,262 @@
+/*
+ * coherence.c - Per-core private caches kept coherent with MESI
+ *
+ * Every core gets its own cache with the geometry given on the command
+ *  line. Reads snoop the other caches (downgrading M/E copies to S) and
+ *  writes invalidate every other copy. Dirty copies given up this way are
+ *  charged to their owner's write-back traffic. Alongside the usual counts
+ *  we keep a byte mask per core for every line that is touched, so lines
+ *  whose cores never touch each other's bytes can be reported as false
+ *  sharing.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void initCoherence(Sim * sim) {
+    Coherence * coh = &sim->coherence;
+    memset(coh, 0, sizeof(*coh));
+    blockMapInit(&coh->sharingMap, 1024);
+    coh->sharingCapacity = 1024;
+    coh->sharing = calloc(coh->sharingCapacity, sizeof(SharingInfo));
+    if(coh->sharing == NULL) {
+        printf("Out of memory in initCoherence\n");
+        exit(-1);
+    }
+}
+
+void freeCoherence(Sim * sim) {
+    blockMapFree(&sim->coherence.sharingMap);
+    free(sim->coherence.sharing);
+    sim->coherence.sharing = NULL;
+}
+
+/*
+ * Builds the mask of bytes an access covers within its block. Blocks
+ *  larger than 64 bytes are tracked in blockSize / 64 byte chunks.
+ *
+ * Params: block size in bytes, address, access size.
+ * Returns: one bit per byte (or chunk) touched.
+ */
+static uint64_t byteMask(int blockSize, uint64_t address, int size) {
+    int grain = blockSize > 64 ? blockSize / 64 : 1;
+    int offset = (int)(address & (uint64_t)(blockSize - 1));
+    int last = offset + (size > 0 ? size : 1) - 1;
+    int first, bit;
+    uint64_t mask = 0;
+
+    if(last > blockSize - 1) last = blockSize - 1;  //accesses that straddle blocks
+    first = offset / grain;
+    last = last / grain;
+    for(bit = first; bit <= last; bit++) {
+        mask |= 1ULL << bit;
+    }
+    return mask;
+}
+
+static SharingInfo * sharingInfo(Coherence * coh, uint64_t block) {
+    int created;
+    size_t * slot = blockMapInsert(&coh->sharingMap, block, &created);
+    if(created) {
+        *slot = coh->sharingMap.count - 1;
+        if(*slot >= coh->sharingCapacity) {
+            coh->sharingCapacity *= 2;
+            coh->sharing = realloc(coh->sharing, coh->sharingCapacity * sizeof(SharingInfo));
+            if(coh->sharing == NULL) {
+                printf("Out of memory in sharingInfo\n");
+                exit(-1);
+            }
+        }
+        memset(&coh->sharing[*slot], 0, sizeof(SharingInfo));
+    }
+    return &coh->sharing[*slot];
+}
+
+/*
+ * Invalidates every copy of a block held by a core other than the writer.
+ *
+ * Returns: number of copies invalidated.
+ */
+static int invalidateOthers(Sim * sim, int core, uint64_t block, uint64_t setNum) {
+    int other, index, count = 0;
+    for(other = 0; other < sim->numCores; other++) {
+        if(other == core) continue;
+        index = findDuplicateTag(sim->caches[other], block, setNum);
+        if(index != -1) {
+            Line * line = &getSet(sim->caches[other], setNum)[index];
+            if(line->state == STATE_M) {    //dirty data is flushed before it goes away
+                sim->caches[other]->traffic.bytesWritten += sim->caches[other]->blockSize;
+            }
+            line->state = STATE_I;
+            line->stale = 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Snoops the other caches on a read miss. M and E copies drop to S; an M
+ *  copy supplies the data (an intervention).
+ *
+ * Returns: 1 if any other core still holds the block, 0 otherwise.
+ */
+static int snoopRead(Sim * sim, int core, uint64_t block, uint64_t setNum) {
+    int other, index, shared = 0;
+    for(other = 0; other < sim->numCores; other++) {
+        if(other == core) continue;
+        index = findDuplicateTag(sim->caches[other], block, setNum);
+        if(index != -1) {
+            Line * line = &getSet(sim->caches[other], setNum)[index];
+            if(line->state == STATE_M) {
+                sim->coherence.interventions++;
+                sim->caches[other]->traffic.bytesWritten += sim->caches[other]->blockSize;
+            }
+            line->state = STATE_S;
+            shared = 1;
+        }
+    }
+    return shared;
+}
+
+/*
+ * Scans a set for the invalidated remains of a block.
+ *
+ * Returns: index of the stale line, -1 if there is none.
+ */
+static int findStaleTag(Cache * cache, uint64_t tag, uint64_t setNum) {
+    int i;
+    Line * set = getSet(cache, setNum);
+    for(i = 0; i < cache->linesPerSet; i++) {
+        if(set[i].state == STATE_I && set[i].stale && set[i].tag == tag) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Performs one load or store from a core, keeping every private cache
+ *  coherent.
+ *
+ * Params: sim pointer, core id, address, access size, nonzero for a store.
+ * Returns: ACCESS_* flags for the requesting core's cache.
+ */
+int coherentAccess(Sim * sim, int core, uint64_t address, int size, int isWrite) {
+    Coherence * coh = &sim->coherence;
+    Cache * cache = sim->caches[core];
+    uint64_t block = address >> cache->numBlockBits;
+    uint64_t setNum = getSetIndex(cache, block);
+    SharingInfo * info = sharingInfo(coh, block);
+    uint64_t mask = byteMask(cache->blockSize, address, size);
+    int index, killed, state, stale;
+
+    info->touched[core] |= mask;
+    if(isWrite) info->written[core] |= mask;
+
+    index = findDuplicateTag(cache, block, setNum);
+    if(index != -1) {
+        Line * line = &getSet(cache, setNum)[index];
+        if(isWrite) {
+            if(line->state == STATE_S) {
+                killed = invalidateOthers(sim, core, block, setNum);
+                coh->invalidations += killed;
+                info->invalidations += killed;
+                coh->upgrades++;
+            }
+            line->state = STATE_M;
+        }
+        insertAndAdjustLRU(cache, setNum, index);
+        return ACCESS_HIT;
+    }
+
+    stale = findStaleTag(cache, block, setNum);
+    if(stale != -1) {
+        coh->coherenceMisses++;
+        getSet(cache, setNum)[stale].stale = 0;
+    }
+    if(isWrite) {
+        killed = invalidateOthers(sim, core, block, setNum);
+        coh->invalidations += killed;
+        info->invalidations += killed;
+        state = STATE_M;
+    }
+    else {
+        state = snoopRead(sim, core, block, setNum) ? STATE_S : STATE_E;
+    }
+    cache->traffic.bytesRead += cache->blockSize;
+    if(fillLine(cache, block, setNum, state, NULL)) {
+        return ACCESS_MISS | ACCESS_EVICT;
+    }
+    return ACCESS_MISS;
+}
+
+/*
+ * A line is falsely shared when more than one core touched it, at least
+ *  one of them wrote it, and no byte written by one core was touched by
+ *  any other core.
+ *
+ * Returns: 0 private or read-only, 1 false sharing, 2 true sharing.
+ */
+static int classifySharing(const SharingInfo * info, int numCores) {
+    int c, d, users = 0, writers = 0;
+    for(c = 0; c < numCores; c++) {
+        if(info->touched[c]) users++;
+        if(info->written[c]) writers++;
+    }
+    if(users < 2 || writers == 0) {
+        return 0;
+    }
+    for(c = 0; c < numCores; c++) {
+        for(d = 0; d < numCores; d++) {
+            if(c != d && (info->written[c] & info->touched[d])) {
+                return 2;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * Prints per-core counts and the coherence statistics after the usual
+ *  summary line. Verbose mode also lists every falsely shared line.
+ */
+void printCoherenceSummary(Sim * sim) {
+    Coherence * coh = &sim->coherence;
+    BlockMap * map = &coh->sharingMap;
+    unsigned long falseLines = 0, trueLines = 0, falseInvalidations = 0;
+    size_t i;
+    int c;
+
+    for(c = 0; c < sim->numCores; c++) {
+        printf("core %d: hits:%lu misses:%lu evictions:%lu\n", c,
+               sim->coreStats[c].hits, sim->coreStats[c].misses, sim->coreStats[c].evictions);
+    }
+    printf("invalidations:%lu coherence_misses:%lu upgrades:%lu interventions:%lu\n",
+           coh->invalidations, coh->coherenceMisses, coh->upgrades, coh->interventions);
+    for(i = 0; i < map->capacity; i++) {
+        SharingInfo * info;
+        int kind;
+        if(!map->used[i]) continue;
+        info = &coh->sharing[map->values[i]];
+        kind = classifySharing(info, sim->numCores);
+        if(kind == 1) {
+            falseLines++;
+            falseInvalidations += info->invalidations;
+            if(sim->verbose) {
+                printf("false sharing: line %lx invalidations:%lu cores:",
+                       (unsigned long)(map->keys[i] << sim->caches[0]->numBlockBits), info->invalidations);
+                for(c = 0; c < sim->numCores; c++) {
+                    if(info->touched[c]) printf(" %d", c);
+                }
+                printf("\n");
+            }
+        }
+        else if(kind == 2) {
+            trueLines++;
+        }
+    }
+    printf("false_sharing_lines:%lu false_sharing_invalidations:%lu true_sharing_lines:%lu\n",
+           falseLines, falseInvalidations, trueLines);
+}
@@ -0,0 +1,351 @@
+/*
+ * conflict.c - Options for measuring and removing conflict misses
+ *
+ *  -x       XOR-fold the whole block address down to s bits to pick the
+ *           set, the way most last level caches hash their index
+ *  -k       skewed associativity: way w of the cache is indexed by its
+ *           own hash h_w(block), so blocks that collide in one way are
+ *           usually apart in the others
+ *  -V <n>   an n entry fully associative victim cache behind the cache
+ *  -C       sort misses into cold, capacity and conflict by running a
+ *           fully associative LRU cache of the same size alongside
+ *
+ * The victim cache is a Cache with a single set, so it reuses the same
+ *  lookup and LRU code as everything else. With a victim cache the
+ *  hit/miss/eviction counts describe the cache and victim cache together:
+ *  a victim hit is a hit and only lines dropped by the victim cache count
+ *  as evictions.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * XOR folds a block address into a set index.
+ *
+ * Params: cache pointer, block address.
+ * Returns: set number.
+ */
+uint64_t hashSetIndex(Cache * cache, uint64_t block) {
+    uint64_t index = 0;
+    uint64_t mask = ((uint64_t)1 << cache->numSetBits) - 1;
+    if(cache->numSetBits == 0) {
+        return 0;
+    }
+    while(block != 0) {
+        index ^= block & mask;
+        block >>= cache->numSetBits;
+    }
+    return index;
+}
+
+/*
+ * Per-way hash for skewed associativity: a multiplicative hash with a
+ *  different odd multiplier for every way, keeping the top s bits.
+ */
+static uint64_t skewIndex(Cache * cache, uint64_t block, int way) {
+    uint64_t mult = (0x9e3779b97f4a7c15ULL + (uint64_t)way * 0xd6e8feb86659fd93ULL) | 1;
+    if(cache->numSetBits == 0) {
+        return 0;
+    }
+    return (block * mult) >> (64 - cache->numSetBits);
+}
+
+/*
+ * Starts counting misses per set. A sparse cache may have far more sets
+ *  than memory, so its counts are kept only for the sets that miss.
+ *
+ * Returns: 0, or -1 if the counts can't be allocated.
+ */
+int initSetMisses(Cache * cache) {
+    if(cache->dense == NULL) {
+        blockMapInit(&cache->conflict.setMissMap, 1024);
+    }
+    else {
+        cache->conflict.setMisses = calloc(cache->numSets, sizeof(unsigned long));
+        if(cache->conflict.setMisses == NULL) {
+            return -1;
+        }
+    }
+    cache->conflict.countSets = 1;
+    return 0;
+}
+
+void countSetMiss(Cache * cache, uint64_t setNum) {
+    if(cache->conflict.setMisses) cache->conflict.setMisses[setNum]++;
+    else (*blockMapInsert(&cache->conflict.setMissMap, setNum, NULL))++;
+}
+
+/*
+ * Checks the victim cache on a miss. A matching line is taken out of the
+ *  victim cache so the caller can put it back in the main cache.
+ *
+ * Params: cache pointer, block address, state receives the line's state.
+ * Returns: 1 on a victim hit, 0 otherwise.
+ */
+int victimLookup(Cache * cache, uint64_t block, int * state) {
+    Cache * vc = cache->victimCache;
+    int index = findDuplicateTag(vc, block, 0);
+    Line * line;
+    if(index == -1) {
+        return 0;
+    }
+    line = &getSet(vc, 0)[index];
+    *state = line->state;
+    line->state = STATE_I;
+    cache->conflict.victimHits++;
+    return 1;
+}
+
+/*
+ * Moves a line evicted from the cache into the victim cache. The victim
+ *  cache's own LRU line falls out if it is full, and pays the write-back.
+ *
+ * Returns: 1 if a line left the victim cache, 0 otherwise.
+ */
+int victimInsert(Cache * cache, const Line * victim) {
+    cache->conflict.victimInserts++;
+    return fillLine(cache->victimCache, victim->tag, 0, victim->state, NULL);
+}
+
+/*
+ * Performs one load or store against a skewed associative cache. Each
+ *  way is looked up at its own set; the line replaced is an empty one if
+ *  there is any, otherwise the least recently used of the candidates.
+ *  Write policies and the victim cache behave as in accessCache.
+ *
+ * Params: cache pointer, address, access size, nonzero if the access is a store.
+ * Returns: ACCESS_* flags describing what happened.
+ */
+int skewedAccess(Cache * cache, uint64_t address, int size, int isWrite) {
+    uint64_t block = address >> cache->numBlockBits;
+    uint64_t setNum, choiceSet = 0;
+    int w, victimState;
+    int state = STATE_E;
+    int result = ACCESS_MISS;
+    Line * line;
+    Line * choice = NULL;
+
+    cache->clock++;
+    if(isWrite) {
+        if(cache->writeThrough) cache->traffic.bytesWritten += size;
+        else state = STATE_M;
+    }
+    for(w = 0; w < cache->linesPerSet; w++) {
+        line = &getSet(cache, skewIndex(cache, block, w))[w];
+        if(line->state != STATE_I && line->tag == block) {
+            if(state == STATE_M) line->state = STATE_M;
+            line->lastUse = cache->clock;
+            return ACCESS_HIT;
+        }
+    }
+    if(cache->victimCache && victimLookup(cache, block, &victimState)) {
+        result = ACCESS_HIT;
+        if(victimState == STATE_M) state = STATE_M;
+    }
+    else {
+        if(isWrite && !cache->writeAllocate) {
+            if(!cache->writeThrough) cache->traffic.bytesWritten += size;
+            return ACCESS_MISS;
+        }
+        cache->traffic.bytesRead += cache->blockSize;
+    }
+
+    for(w = 0; w < cache->linesPerSet; w++) {
+        setNum = skewIndex(cache, block, w);
+        line = &getSet(cache, setNum)[w];
+        if(choice == NULL || (choice->state != STATE_I &&
+                              (line->state == STATE_I || line->lastUse < choice->lastUse))) {
+            choice = line;
+            choiceSet = setNum;
+        }
+    }
+    if(choice->state != STATE_I) {
+        if(cache->victimCache) {
+            if(victimInsert(cache, choice)) {
+                result |= ACCESS_EVICT;
+                cache->lastVictim = cache->victimCache->lastVictim;
+            }
+        }
+        else {
+            result |= ACCESS_EVICT;
+            cache->lastVictim = choice->tag;
+            if(choice->state == STATE_M) {
+                cache->traffic.dirtyEvictions++;
+                cache->traffic.bytesWritten += cache->blockSize;
+            }
+        }
+    }
+    if(cache->conflict.countSets && (result & ACCESS_MISS)) {
+        countSetMiss(cache, choiceSet);
+    }
+    choice->tag = block;
+    choice->state = state;
+    choice->stale = 0;
+    choice->prefetched = 0;
+    choice->lastUse = cache->clock;
+    return result;
+}
+
+#define NO_LINE ((size_t)-1)
+
+static void unlinkShadow(MissClassifier * mc, size_t i) {
+    ShadowLine * line = &mc->shadow[i];
+    if(line->prev != NO_LINE) mc->shadow[line->prev].next = line->next;
+    else mc->mru = line->next;
+    if(line->next != NO_LINE) mc->shadow[line->next].prev = line->prev;
+    else mc->lru = line->prev;
+}
+
+static void pushShadow(MissClassifier * mc, size_t i) {
+    mc->shadow[i].prev = NO_LINE;
+    mc->shadow[i].next = mc->mru;
+    if(mc->mru != NO_LINE) mc->shadow[mc->mru].prev = i;
+    else mc->lru = i;
+    mc->mru = i;
+}
+
+/*
+ * Sets up the fully associative shadow cache used to sort misses. Its
+ *  lines are a list in LRU order, found through the seen map, so an
+ *  access costs the same however large the cache is. Lines are allocated
+ *  as blocks arrive, so a huge cache only costs what the trace touches.
+ */
+void initMissClassifier(Sim * sim) {
+    MissClassifier * mc = &sim->classifier;
+    Cache * cache = sim->caches[0];
+    mc->shadowLines = cache->numSets * cache->linesPerSet;
+    if(cache->numSets > UINT64_MAX / cache->linesPerSet) {
+        mc->shadowLines = UINT64_MAX;
+    }
+    mc->shadowAllocated = 1024;
+    mc->shadow = malloc(mc->shadowAllocated * sizeof(ShadowLine));
+    if(mc->shadow == NULL) {
+        printf("Out of memory in initMissClassifier\n");
+        exit(-1);
+    }
+    mc->numBlockBits = cache->numBlockBits;
+    mc->writeAllocate = cache->writeAllocate;
+    mc->shadowUsed = 0;
+    mc->mru = mc->lru = NO_LINE;
+    blockMapInit(&mc->seen, 1024);
+}
+
+/*
+ * Empties the shadow cache and forgets every block seen so far.
+ */
+void resetMissClassifier(Sim * sim) {
+    MissClassifier * mc = &sim->classifier;
+    mc->shadowUsed = 0;
+    mc->mru = mc->lru = NO_LINE;
+    blockMapFree(&mc->seen);
+    blockMapInit(&mc->seen, 1024);
+}
+
+/*
+ * Runs an access through the shadow cache: a hit moves the line to the
+ *  front, a miss fills a free line or replaces the least recently used
+ *  one (stores that miss skip the fill without write-allocate).
+ *
+ * Returns: 1 on a hit, 0 on a miss.
+ */
+static int shadowAccess(MissClassifier * mc, size_t * resident, uint64_t block, int isWrite) {
+    size_t i;
+    if(*resident) {
+        i = *resident - 1;
+        if(i != mc->mru) {
+            unlinkShadow(mc, i);
+            pushShadow(mc, i);
+        }
+        return 1;
+    }
+    if(isWrite && !mc->writeAllocate) {
+        return 0;
+    }
+    if(mc->shadowUsed < mc->shadowLines) {
+        if(mc->shadowUsed == mc->shadowAllocated) {
+            size_t grown = mc->shadowAllocated * 2;
+            if(grown > mc->shadowLines) grown = mc->shadowLines;
+            mc->shadow = realloc(mc->shadow, grown * sizeof(ShadowLine));
+            if(mc->shadow == NULL) {
+                printf("Out of memory in classifyAccess\n");
+                exit(-1);
+            }
+            mc->shadowAllocated = grown;
+        }
+        i = mc->shadowUsed++;
+    }
+    else {
+        i = mc->lru;
+        unlinkShadow(mc, i);
+        *blockMapFind(&mc->seen, mc->shadow[i].block) = 0;
+    }
+    mc->shadow[i].block = block;
+    pushShadow(mc, i);
+    *resident = i + 1;
+    return 0;
+}
+
+/*
+ * Replays an access against the shadow cache and classifies it if the
+ *  real cache missed: cold if the block was never seen before, conflict
+ *  if the fully associative cache would have hit, capacity otherwise.
+ *
+ * Params: sim pointer, the access, result flags from the real cache.
+ */
+void classifyAccess(Sim * sim, uint64_t address, int size, int isWrite, int result) {
+    MissClassifier * mc = &sim->classifier;
+    int created;
+    size_t * resident = blockMapInsert(&mc->seen, address >> mc->numBlockBits, &created);
+    int shadowHit = shadowAccess(mc, resident, address >> mc->numBlockBits, isWrite);
+    if(!(result & ACCESS_MISS)) {
+        return;
+    }
+    if(created) mc->cold++;
+    else if(shadowHit) mc->conflict++;
+    else mc->capacity++;
+}
+
+void freeConflict(Sim * sim) {
+    if(sim->classifier.shadow) {
+        free(sim->classifier.shadow);
+        blockMapFree(&sim->classifier.seen);
+        sim->classifier.shadow = NULL;
+    }
+}
+
+void printConflictSummary(Sim * sim) {
+    Cache * cache = sim->caches[0];
+    if(cache->victimCache) {
+        printf("victim_hits:%lu victim_inserts:%lu\n",
+               cache->conflict.victimHits, cache->conflict.victimInserts);
+    }
+    if(cache->conflict.countSets) {
+        uint64_t i, used = 0;
+        unsigned long busiest = 0, total = 0;
+        if(cache->conflict.setMisses) {
+            for(i = 0; i < cache->numSets; i++) {
+                unsigned long m = cache->conflict.setMisses[i];
+                if(m) used++;
+                if(m > busiest) busiest = m;
+                total += m;
+            }
+        }
+        else {
+            BlockMap * map = &cache->conflict.setMissMap;
+            for(i = 0; i < map->capacity; i++) {
+                if(map->used[i]) {
+                    used++;
+                    if(map->values[i] > busiest) busiest = map->values[i];
+                    total += map->values[i];
+                }
+            }
+        }
+        printf("sets_with_misses:%lu/%lu busiest_set_misses:%lu mean_set_misses:%.2f\n",
+               (unsigned long)used, (unsigned long)cache->numSets, busiest, (double)total / cache->numSets);
+    }
+    if(sim->classifier.shadow) {
+        printf("cold_misses:%lu capacity_misses:%lu conflict_misses:%lu\n",
+               sim->classifier.cold, sim->classifier.capacity, sim->classifier.conflict);
+    }
+}
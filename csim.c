@@ -1,6 +1,6 @@
 #include "cachelab.h"
+#include "csim.h"
 #include <stdlib.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -13,35 +13,205 @@
  *
  */
 
-typedef struct {
-    int numSets;
-    int numSetBits;
-    int linesPerSet;
-    int numBlockBits;
-    int blockSize;
-    int numTagBits;
-    unsigned long int ** tags;
-}Cache;
-
 //Function Declarations
-int parseCommandLine(int argc, char **argv, int *cache_s, int *cache_E, int *cache_b, char **trace, int *vflag);
-uint64_t getBits(int start, int end, unsigned long bits);
+int parseCommandLine(int argc, char **argv, Sim * sim, char **trace);
+uint64_t getBits(int start, int end, uint64_t bits);
 void errorMessage();
-Cache * createCache(int numSetBits, int linesPerSet, int numBlockBits);
-int parseTraceFile(FILE * pf, char ** trace, Cache *cache, int * h_c, int * m_c, int * e_c);
-void insertAndAdjustLRU(Cache * cache, unsigned long int tag, int setNum);
-//int processM(unsigned long int, int, int, Cache *);
-//int processLS(unsigned long int, int, int, Cache *);
-int findDuplicateTag(Cache * cache, int tag, int setNum);
-int findEmptyLine(Cache * cache, int setNum);
-
-//Global Variable(s)
-int verboseFlag = 0;
-int helpFlag = 0;
+void printUsage(char * name);
+int parseTraceFile(Sim * sim, const char * traceFile);
 
-void errorMessage() { 
+void errorMessage() {
     printf("Error\n");
-    printf("Usage: ./csim-ref [-h] [-v] -s <s> -E <E> -b <b> -t <tracefile>\n");
+    printf("Usage: ./csim [-hv] -s <s> -E <E> -b <b> -t <tracefile> [-c <cores>] [-w wb|wt] [-a wa|nwa]\n");
+    printf("       [-f next|stride|stream [-d <degree>] [-D <distance>] [-L <latency>]]\n");
+    printf("       [-x | -k] [-V <entries>] [-C] [-m <markerfile>] [-z] [-r <window>]\n");
+    printf("       [-A <mapfile>] [-I split|unified [-i <s>,<E>]]\n");
+    printf("       [-T <entries>,<ways>[,<entries>,<ways>] [-P 4k|2m|1g]]\n");
+    printf("       [-o <file> [-W <n>|region] [-p <lambda>]]\n");
+}
+
+void printUsage(char * name) {
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file> [-c <cores>] [-w wb|wt] [-a wa|nwa]\n", name);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Optional verbose flag.\n");
+    printf("  -s <num>   Number of set index bits.\n");
+    printf("  -E <num>   Number of lines per set.\n");
+    printf("  -b <num>   Number of block offset bits.\n");
+    printf("  -t <file>  Trace file.\n");
+    printf("  -c <num>   Simulate <num> private caches kept coherent with MESI.\n");
+    printf("             Trace records may then carry a core id: \" L 10,4,1\"\n");
+    printf("  -w <wb|wt> Write-back (default) or write-through stores.\n");
+    printf("  -a <wa|nwa> Write-allocate (default) or no-write-allocate on store misses.\n");
+    printf("  -f <kind>  Prefetcher: none (default), next, stride or stream.\n");
+    printf("  -d <num>   Prefetch degree: blocks per trigger (default 1, max %d).\n", MAX_PREFETCH_DEGREE);
+    printf("  -D <num>   Prefetch distance: blocks ahead of the trigger (default 1).\n");
+    printf("  -L <num>   Prefetch latency in accesses, used to spot late prefetches (default 16).\n");
+    printf("  -x         XOR-fold the block address to pick the set.\n");
+    printf("  -k         Skewed associativity: a different set hash for every way.\n");
+    printf("  -V <num>   Add a fully associative victim cache of <num> lines.\n");
+    printf("  -C         Classify misses as cold, capacity or conflict.\n");
+    printf("  -m <file>  Count each region between the marker addresses in <file>\n");
+    printf("             (as written by tracegen to .marker) separately.\n");
+    printf("  -z         Empty the caches at the start of every region.\n");
+    printf("  -r <num>   Profile reuse distances at block size 2^b and the working set\n");
+    printf("             over windows of <num> accesses (0 for none). Without -s and\n");
+    printf("             -E only the profile is produced.\n");
+    printf("  -A <file>  Charge misses and evictions to the array elements described\n");
+    printf("             in <file> (as written by tracegen to .addrmap).\n");
+    printf("  -I <mode>  Simulate instruction fetches: split (a separate L1I per core)\n");
+    printf("             or unified (fetches share the data cache).\n");
+    printf("  -i <s>,<E> L1I set index bits and lines per set (default: same as -s/-E).\n");
+    printf("  -T <n>,<w>[,<n>,<w>] Translate data accesses through an L1 TLB of <n>\n");
+    printf("             entries and <w> ways, and optionally an L2 TLB behind it.\n");
+    printf("  -P <size>  Page size: 4k (default), 2m or 1g.\n");
+    printf("  -o <file>  Stream counts per window to <file>: JSON Lines if it ends in\n");
+    printf("             .json, CSV otherwise, stdout for -.\n");
+    printf("  -W <n>     Window of <n> data accesses (default 10000), or region for\n");
+    printf("             one row per region.\n");
+    printf("  -p <num>   Flag phase changes when the windowed miss rate drifts by\n");
+    printf("             more than <num> (Page-Hinkley test, e.g. 0.1).\n");
+    printf("\nServer mode, keeping decoded traces in memory between runs:\n");
+    printf("  %s -S <socket> [-j <threads>] [-M <megabytes>]\n", name);
+    printf("  %s -q <socket> -s <num> -E <num> -b <num> -t <file> [-w wb|wt] [-a wa|nwa]\n", name);
+    printf("             runs on the server, or locally if there is none.\n");
+    printf("\nExamples:\n");
+    printf("  linux>  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", name);
+    printf("  linux>  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", name);
+    printf("  linux>  %s -c 4 -s 5 -E 1 -b 5 -t trace.mt\n", name);
+}
+
+/*
+ * function for getting the bits from the start to the end of an address
+ *
+ * Params: start and end indices (inclusive), the address.
+ * Returns: bits from the ranges specified, shifted down to bit 0.
+ *
+ */
+uint64_t getBits(int start, int end, uint64_t address) {
+    if(start < 64 && start >= 0 && end < 64 && end >= -1 && end >= start - 1) {
+        int width = end - start + 1;
+        if(width == 0) return 0;
+        if(width == 64) return address;
+        return (address >> start) & ((1ULL << width) - 1);
+    }
+    else {
+        errorMessage();
+        printf("getBits\n");
+        exit(-1);
+    }
+}
+
+/*
+ * Function to fill in a cache structure's information that is extracted from the command line
+ *  Small caches get every set in one array; caches of more than
+ *  DENSE_CACHE_LINES lines start empty and give each set storage the
+ *  first time it is touched (see getSet), so memory follows the sets a
+ *  trace uses rather than the configured size.
+ *
+ * Params: s, E, and b
+ * Returns: the new cache, every line starting out invalid.
+ *
+ */
+Cache * createCache(int numSetBits, int linesPerSet, int numBlockBits) {
+    //allocate memory for the cache structure
+    Cache * c_ptr = calloc(1, sizeof(* c_ptr));
+    if(c_ptr != NULL) {
+        c_ptr->numSetBits = numSetBits;
+        c_ptr->numSets = (uint64_t)1 << numSetBits;
+        c_ptr->linesPerSet = linesPerSet;
+        c_ptr->numBlockBits = numBlockBits;
+        c_ptr->blockSize = 1 << numBlockBits;
+        c_ptr->numTagBits = 64 - numSetBits - numBlockBits;
+        c_ptr->writeThrough = 0;
+        c_ptr->writeAllocate = 1;
+        c_ptr->indexHash = INDEX_PLAIN;
+        if(c_ptr->numSets <= DENSE_CACHE_LINES / linesPerSet) {
+            //calloc leaves every line in STATE_I
+            c_ptr->dense = calloc(c_ptr->numSets * linesPerSet, sizeof(Line));
+            if(c_ptr->dense == NULL) {
+                free(c_ptr);
+                return NULL;
+            }
+            c_ptr->setsStored = c_ptr->numSets;
+        }
+        else {
+            c_ptr->setsPerChunk = linesPerSet < ARENA_CHUNK_LINES ? ARENA_CHUNK_LINES / linesPerSet : 1;
+            blockMapInit(&c_ptr->setMap, 1024);
+        }
+    }
+    return c_ptr;
+}
+
+void freeCache(Cache * cache) {
+    size_t i;
+    if(cache == NULL) return;
+    free(cache->dense);
+    if(cache->dense == NULL) {
+        for(i = 0; i < cache->numChunks; i++) {
+            free(cache->chunks[i]);
+        }
+        free(cache->chunks);
+        blockMapFree(&cache->setMap);
+    }
+    free(cache->prefetcher);
+    free(cache->conflict.setMisses);
+    if(cache->conflict.countSets && cache->dense == NULL) {
+        blockMapFree(&cache->conflict.setMissMap);
+    }
+    freeCache(cache->victimCache);
+    free(cache);
+}
+
+/*
+ * Maps a block address to the set it lives in.
+ */
+uint64_t getSetIndex(Cache * cache, uint64_t block) {
+    if(cache->indexHash == INDEX_XOR) {
+        return hashSetIndex(cache, block);
+    }
+    return getBits(0, cache->numSetBits - 1, block);
+}
+
+/*
+ * Returns the k-th set that has storage, in the order the sets were
+ *  first touched (for a dense cache, simply set k).
+ */
+Line * getStoredSet(Cache * cache, size_t k) {
+    if(cache->dense) {
+        return cache->dense + k * cache->linesPerSet;
+    }
+    return cache->chunks[k / cache->setsPerChunk] + (k % cache->setsPerChunk) * cache->linesPerSet;
+}
+
+/*
+ * Returns the row of lines making up a set. In a sparse cache a set
+ *  touched for the first time gets the next free slot in the arena.
+ */
+Line * getSet(Cache * cache, uint64_t setNum) {
+    int created;
+    size_t * slot;
+    if(cache->dense) {
+        return cache->dense + setNum * cache->linesPerSet;
+    }
+    slot = blockMapInsert(&cache->setMap, setNum, &created);
+    if(created) {
+        if(cache->setsStored == cache->numChunks * cache->setsPerChunk) {
+            cache->chunks = realloc(cache->chunks, (cache->numChunks + 1) * sizeof(Line *));
+            if(cache->chunks == NULL) {
+                printf("Out of memory in getSet\n");
+                exit(-1);
+            }
+            cache->chunks[cache->numChunks] = calloc(cache->setsPerChunk * cache->linesPerSet, sizeof(Line));
+            if(cache->chunks[cache->numChunks] == NULL) {
+                printf("Out of memory in getSet\n");
+                exit(-1);
+            }
+            cache->numChunks++;
+        }
+        *slot = cache->setsStored++;
+    }
+    return getStoredSet(cache, *slot);
 }
 
 /*
@@ -51,294 +221,851 @@ void errorMessage() {
  * Params: cache pointer, tag, set number.
  * Returns: index of matched tag if a match is found. -1 if tag is not already present.
  */
-int findDuplicateTag(Cache * cache, int tag, int setNum) {
+int findDuplicateTag(Cache * cache, uint64_t tag, uint64_t setNum) {
     int i;
+    Line * set;
+    if(cache->dense) {
+        set = cache->dense + setNum * cache->linesPerSet;
+    }
+    else {
+        //a lookup alone (a snoop, say) shouldn't allocate the set
+        size_t * slot = blockMapFind(&cache->setMap, setNum);
+        if(slot == NULL) return -1;
+        set = getStoredSet(cache, *slot);
+    }
     for(i = 0; i < cache->linesPerSet; i++) {
-        if(cache->tags[setNum][i] == tag) {
+        if(set[i].state != STATE_I && set[i].tag == tag) {
             return i;
         }
     }
     return -1;
 }
+
 /*
  * Scans every line in a set and returns the line index number if one is found.
+ *  Searches from the LRU end so lines freed by an invalidation get reused first.
  *
  * Params:  cache pointer, set Number to iterate through
  * Returns: -1 if no line is empty.
  *          Line index if empty line is found.
  */
-int findEmptyLine(Cache * cache, int setNum) {
+int findEmptyLine(Cache * cache, uint64_t setNum) {
     int i;
-    for(i = 0; i < cache->linesPerSet; i++) {
-        if(cache->tags[setNum][i] == -1) return i;
+    Line * set = getSet(cache, setNum);
+    for(i = cache->linesPerSet - 1; i >= 0; i--) {
+        if(set[i].state == STATE_I) return i;
     }
     return -1;
 }
+
 /*
-int processM(unsigned long int address, int startIndex, int endIndex, Cache * cache) {
-    int setNum, i;
-    int numHits = 0;
-    unsigned long int tag;
-    tag = getBits(startIndex, endIndex, address);
-    for(i = 0; i < cache->linesPerSet; i++) {
-        if(cache->tags[setNum][i] != -1 && cache->tags[setNum][i] == tag) {
-            numHits++;
-            insertAndAdjustLRU(cache, tag, setNum);
-        }
+ * Function used to adjust the ordering of the lines in the set
+ *  to keep them in least recently used order. The line at index is
+ *  moved to the beginning of the set, as it is now the most recently
+ *  used line, and every line in front of it moves down one.
+ *
+ *  Params: cache pointer, set number, index of the line that was just used
+ *
+ */
+void insertAndAdjustLRU(Cache * cache, uint64_t setNum, int index) {
+    int i;
+    Line * set = getSet(cache, setNum);
+    Line used = set[index];
+    for(i = index; i > 0; i--) {
+        set[i] = set[i - 1];
     }
-    for(i = 0; i < cache->linesPerSet; i++) {
-        if(cache->tags[setNum][i] == tag) {
-            numHits++;
+    set[0] = used;
+}
+
+/*
+ * Brings a block into a set, evicting the least recently used line if
+ *  the set is full. The new line becomes the most recently used. A dirty
+ *  victim is charged to the cache's write-back traffic unless a victim
+ *  cache will take it; the caller charges the fill itself, since only it
+ *  knows where the data came from.
+ *
+ * Params: cache pointer, tag, set number, state for the new line,
+ *         victim receives the evicted line (may be NULL).
+ * Returns: 1 if a valid line was evicted, 0 otherwise.
+ */
+int fillLine(Cache * cache, uint64_t tag, uint64_t setNum, int state, Line * victim) {
+    int evicted = 0;
+    Line * set = getSet(cache, setNum);
+    int index = findEmptyLine(cache, setNum);
+    if(index == -1) {
+        index = cache->linesPerSet - 1;
+        evicted = 1;
+        if(set[index].state == STATE_M && cache->victimCache == NULL) {
+            cache->traffic.dirtyEvictions++;
+            cache->traffic.bytesWritten += cache->blockSize;
         }
+        if(victim) *victim = set[index];
+        cache->lastVictim = set[index].tag;
     }
-    return numHits;
+    set[index].tag = tag;
+    set[index].state = state;
+    set[index].stale = 0;
+    set[index].prefetched = 0;
+    insertAndAdjustLRU(cache, setNum, index);
+    return evicted;
 }
 
-int processLS(unsigned long int address, int startIndex, int endIndex, Cache * cache) {
-    int setNum, i;
-    int numHits = 0;
-    unsigned long int tag;
-    tag = getBits(startIndex, endIndex, address);
+/*
+ * Empties a cache (and its victim cache), writing back any dirty lines.
+ *  Prefetcher tables are cleared as well; its statistics are kept.
+ */
+void flushCache(Cache * cache) {
+    size_t i;
+    int j;
+    for(i = 0; i < cache->setsStored; i++) {
+        Line * set = getStoredSet(cache, i);
+        for(j = 0; j < cache->linesPerSet; j++) {
+            if(set[j].state == STATE_M) {
+                cache->traffic.bytesWritten += cache->blockSize;
+            }
+            set[j].state = STATE_I;
+            set[j].stale = 0;
+            set[j].prefetched = 0;
+        }
+    }
+    if(cache->prefetcher) {
+        Prefetcher * pf = cache->prefetcher;
+        memset(pf->strideTable, 0, sizeof(pf->strideTable));
+        memset(pf->buffers, 0, sizeof(pf->buffers));
+        memset(pf->pollutionFilter, 0, sizeof(pf->pollutionFilter));
+    }
+    if(cache->victimCache) {
+        flushCache(cache->victimCache);
+    }
 }
-*/
+
 /*
- * function for getting the bits from the start to the end of an unsigned long int
- *
- * Params: start and end indices, the address.
- * Returns: bits from the ranges specified.
+ * Performs one load or store against a single private cache.
+ *  Write-back stores mark the line dirty; write-through stores send the
+ *  stored bytes on and leave the line clean. Without write-allocate a
+ *  store miss goes straight to the next level and nothing is filled.
+ *  When a prefetcher is attached it sees every access after the fact, and
+ *  a miss that a stream buffer can satisfy counts as a hit. The same goes
+ *  for a victim cache hit; lines only count as evicted once they fall out
+ *  of the victim cache.
  *
+ * Params: cache pointer, address, access size, nonzero if the access is a store.
+ * Returns: ACCESS_* flags describing what happened.
  */
-uint64_t getBits(int start, int end, unsigned long address) {
-    int i;
-    unsigned long mask = 0UL;
-    if(start < 64 && start >= 0 && end < 64 && end >= 0) {
-        int diff = end - start;
-        for (i = 0; i < diff; i++) {
-            mask <<= 1;
-            mask |= 1;
-        }
-        mask <<= start;
-        address &= mask; 
-        return address;
+int accessCache(Cache * cache, uint64_t address, int size, int isWrite) {
+    uint64_t tag, setNum;
+    int index;
+    int state = STATE_E;
+    int result = ACCESS_MISS;
+    int firstUse = 0;
+    Prefetcher * pf = cache->prefetcher;
+    Line victim;
+    int victimState;
+
+    //hand off before any generic lookup, which the kernels do themselves
+    if(cache->kernel) {
+        return cache->kernel(cache, address, isWrite);
+    }
+    if(cache->indexHash == INDEX_SKEW) {
+        return skewedAccess(cache, address, size, isWrite);
+    }
+    tag = address >> cache->numBlockBits;
+    setNum = getSetIndex(cache, tag);
+    index = findDuplicateTag(cache, tag, setNum);
+    if(pf) pf->clock++;
+    if(isWrite) {
+        if(cache->writeThrough) cache->traffic.bytesWritten += size;
+        else state = STATE_M;
+    }
+    if(index != -1) {
+        Line * line = &getSet(cache, setNum)[index];
+        if(pf) firstUse = prefetchHit(cache, line);
+        if(state == STATE_M) line->state = STATE_M;
+        insertAndAdjustLRU(cache, setNum, index);
+        if(pf) prefetchTrain(cache, tag, 0, firstUse);
+        return ACCESS_HIT;
+    }
+    if(pf && streamBufferLookup(cache, tag)) {
+        result = ACCESS_HIT;
+    }
+    else if(cache->victimCache && victimLookup(cache, tag, &victimState)) {
+        result = ACCESS_HIT;
+        if(victimState == STATE_M) state = STATE_M;
     }
     else {
-        errorMessage();
-        printf("getBits\n");
-        exit(-1);
+        if(pf) prefetchNoteMiss(cache, tag);
+        if(isWrite && !cache->writeAllocate) {
+            if(!cache->writeThrough) cache->traffic.bytesWritten += size;
+            if(pf) prefetchTrain(cache, tag, 1, 0);
+            return ACCESS_MISS;
+        }
+        cache->traffic.bytesRead += cache->blockSize;
     }
+    if(cache->conflict.countSets && (result & ACCESS_MISS)) {
+        countSetMiss(cache, setNum);
+    }
+    if(fillLine(cache, tag, setNum, state, &victim)) {
+        if(cache->victimCache == NULL) {
+            result |= ACCESS_EVICT;
+        }
+        else if(victimInsert(cache, &victim)) {
+            result |= ACCESS_EVICT;
+            cache->lastVictim = cache->victimCache->lastVictim;
+        }
+        if(pf) prefetchNoteEviction(cache, &victim, 0);
+    }
+    if(pf) prefetchTrain(cache, tag, result & ACCESS_MISS, 0);
+    return result;
 }
 
 /*
- * Function to fill in a cache structure's information that is extracted from the command line
- *
- * Params: cache pointer, s, E, and b
+ * Decodes one line of a valgrind lackey trace. Data records look like
+ *  " L 10,4" and instruction fetches like "I  0400d7d4,8". An optional
+ *  trailing ",<core>" field names the core that made the access.
+ *  "R begin <label>" and "R end" lines bound a region of interest.
  *
+ * Params: the text of the line, record to fill in,
+ *         label receives a region's label (REGION_LABEL_MAX bytes).
+ * Returns: 1 if the line was a memory access or region record, 0 if it should be skipped.
  */
-Cache * createCache(int numSetBits, int linesPerSet, int numBlockBits) {
-    int i, j;
-    //allocate memory for the cache structure
-    Cache * c_ptr = malloc(sizeof(* c_ptr));
-    if(c_ptr != NULL) {
-        c_ptr->numSetBits = numSetBits;
-        c_ptr->numSets = (int)pow(2, numSetBits);
-        c_ptr->linesPerSet = linesPerSet;
-        c_ptr->numBlockBits = numBlockBits;
-        c_ptr->blockSize = (int)pow(2, numBlockBits);
-        c_ptr->numTagBits = 63 - numSetBits - numBlockBits;
-        //allocate memory for the 2D tags array
-        c_ptr->tags = malloc(c_ptr->numSets * linesPerSet * sizeof(unsigned long int));
-        c_ptr->tags = malloc(sizeof(unsigned long int) * c_ptr->numSets);
-        for(i = 0; i < c_ptr->numSets; i++) {
-            c_ptr->tags[i] = malloc(sizeof(unsigned long int) * linesPerSet);
-        }
-        //initialize tags to -1
-        for(i = 0; i < c_ptr->numSets; i++) {
-            for(j = 0; j < linesPerSet; j++) {
-                c_ptr->tags[i][j] = -1;
-            }
+int parseTraceLine(const char * buf, TraceRecord * rec, char * label) {
+    char op;
+    unsigned long address;
+    int size;
+    int core = 0;
+    int n;
+
+    if(buf[0] == 'R' && buf[1] == ' ') {
+        char word[8];
+        rec->op = 'R';
+        rec->address = 0;
+        rec->core = 0;
+        label[0] = '\0';
+        n = sscanf(buf + 2, "%7s %63s", word, label);
+        if(n >= 1 && strcmp(word, "end") == 0) {
+            rec->size = 0;
+            return 1;
         }
+        if(n == 2 && strcmp(word, "begin") == 0) {
+            rec->size = 1;
+            return 1;
+        }
+        return 0;
+    }
+    if(buf[0] != ' ' && buf[0] != 'I') {  //valgrind banner lines and the like
+        return 0;
+    }
+    n = sscanf(buf, " %c %lx,%d,%d", &op, &address, &size, &core);
+    if(n < 3) {
+        return 0;
     }
-    return c_ptr;    
+    if(op != 'L' && op != 'S' && op != 'M' && op != 'I') {
+        return 0;
+    }
+    rec->op = op;
+    rec->address = address;
+    rec->size = size;
+    rec->core = (n == 4) ? core : 0;
+    return 1;
 }
 
 /*
- * Function used to adjust the ordering of the lines in the set
- *  to keep them in least recently used order and then insert the
- *  new tag into the beginning of the set, as it was the most recently
- *  used line.
- *
- *  Algorithm evicts the least recently used tag automatically if the set is full
- *
- *  Params: cache pointer, tag number, set number
+ * Runs one trace record through the simulated caches, updating the
+ *  hit/miss/eviction counts and printing the outcome when verbose.
+ *  A modify is a load followed by a store to the same address.
  *
+ * Params: sim pointer, decoded record.
  */
-void insertAndAdjustLRU(Cache * cache, unsigned long int tag, int setNum) {
-    int i;
-    int index;
-    index = findDuplicateTag(cache, tag, setNum);
+void simulateAccess(Sim * sim, const TraceRecord * rec) {
+    int pass, passes, result, core;
+    Stats * coreStats;
+    Stats * regionStats = NULL;
 
-    //if the findDuplicateTag does not find an identical tag in the set
-    if(index == -1) {
-        //iterate through the lines in the set and move them all down 1
-        for(i = cache->linesPerSet - 1; i > 1; i--) {
-            cache->tags[setNum][i] = cache->tags[setNum][i - 1]; 
-        }
-        //then set the most recently used index of the array to the new tag
-        cache->tags[setNum][0] = tag;
+    if(rec->op == 'I') {        //instruction fetches only with csim -I
+        if(sim->ifetchMode != IFETCH_NONE) simulateFetch(sim, rec);
+        return;
     }
-    //else the tag was already present. just need to move the tag to the 
-    //front of the array and move everything else down.
-    else {
-        for(i = index; i > 1; i--) {
-            cache->tags[setNum][i] = cache->tags[setNum][i-1];
+    if(sim->profileOnly) {
+        reuseAccess(sim, rec->address);
+        if(rec->op == 'M') reuseAccess(sim, rec->address);
+        return;
+    }
+    core = sim->numCores > 1 ? rec->core : 0;
+    coreStats = &sim->coreStats[core];
+    if(sim->regions.current != -1) {
+        regionStats = &sim->regions.list[sim->regions.current].stats;
+    }
+    if(sim->verbose) {
+        if(sim->numCores > 1) printf("%c %lx,%d,%d", rec->op, (unsigned long)rec->address, rec->size, core);
+        else printf("%c %lx,%d", rec->op, (unsigned long)rec->address, rec->size);
+    }
+    passes = (rec->op == 'M') ? 2 : 1;
+    for(pass = 0; pass < passes; pass++) {
+        int isWrite = (rec->op == 'S') || (pass == 1);
+        if(sim->reuse) {
+            reuseAccess(sim, rec->address);
+        }
+        if(sim->tlbs[core].l1) {
+            int translation = translate(sim, core, rec->address);
+            if(sim->verbose && translation == TLB_L2_HIT) printf(" tlb-miss");
+            if(sim->verbose && translation == TLB_WALK) printf(" page-walk");
+        }
+        if(sim->numCores > 1) {
+            result = coherentAccess(sim, core, rec->address, rec->size, isWrite);
+        }
+        else {
+            result = accessCache(sim->caches[0], rec->address, rec->size, isWrite);
+            if(sim->classifier.shadow) {
+                classifyAccess(sim, rec->address, rec->size, isWrite, result);
+            }
+        }
+        if(sim->addressMap) {
+            attributeAccess(sim->addressMap, sim->caches[core], rec->address, result);
+        }
+        if(result & ACCESS_HIT) {
+            sim->stats.hits++;
+            coreStats->hits++;
+            if(regionStats) regionStats->hits++;
+            if(sim->verbose) printf(" hit");
+        }
+        if(result & ACCESS_MISS) {
+            sim->stats.misses++;
+            coreStats->misses++;
+            if(regionStats) regionStats->misses++;
+            if(sim->verbose) printf(" miss");
         }
-        cache->tags[setNum][0] = tag;    
-    }   
+        if(result & ACCESS_EVICT) {
+            sim->stats.evictions++;
+            coreStats->evictions++;
+            if(regionStats) regionStats->evictions++;
+            if(sim->verbose) printf(" eviction");
+        }
+        if(sim->series) {
+            seriesAccess(sim);
+        }
+    }
+    if(sim->verbose) printf("\n");
 }
 
 /*
  * Function to go through a trace file line by line and update the miss/hit/eviction counts based
- *  off of the information it extracts.
+ *  off of the information it extracts. Region records and marker accesses
+ *  open and close regions of interest along the way.
  *
- *  Params: file pointer, tracefile, and then pointers for: cache, hit count, miss count, eviction count.
+ *  Params: sim pointer, trace file name.
  *  Return: -1 if error. 0 if not.
  *
  */
-int parseTraceFile(FILE * pf, char ** traceFile, Cache * cache, int * h_c, int * m_c, int * e_c) {
-    int i;
-    char buf[80];
-    unsigned long int address;
-    char option;
-    int size, setNum;
-    unsigned long int tag;
-    int setEndBit = cache->numBlockBits + cache->numSetBits;
+int parseTraceFile(Sim * sim, const char * traceFile) {
+    char buf[256];
+    char label[REGION_LABEL_MAX];
+    TraceRecord rec;
+    Regions * regions = &sim->regions;
+    FILE * pf = fopen(traceFile, "r");
 
-    pf = fopen(* traceFile, "r");
     if(!pf) {
         printf("Can't open trace file\n");
         return -1;
     }
-    while(fgets(buf, 80, pf) != NULL) {
-        if(buf[0] == ' ') {         //If the line begins with a space, we don't ignore it.
-            sscanf(buf, " %c %lu,%d", &option, &address, &size);
-        }
-        printf("%s", buf);
-        setNum = getBits(cache->numBlockBits, setEndBit - 1, address);
-        tag = getBits(setEndBit, 63, address);
-        printf("numBlockBits: %d, setEndBit: %d, address: %lu\n", cache->numBlockBits, setEndBit, address);
-        printf("numTagBits: %d\n", cache->numTagBits);
-        printf("tag: %lu\n", tag);
-        printf("setNum: %d\n", setNum);
-        printf("option: %c\n", option);
-        for(i = 0; i < cache->linesPerSet; i++) {
-           printf("first for loop\n");
-           if(tag == cache->tags[setNum][i]) { //If it is valid and matches the tag
-               printf("1\n");
-               printf("option: %c\n", option);
-                if (option == 'M') {
-                   *h_c = *h_c + 2;
-                }
-                else *h_c = *h_c + 1;
-                printf("hit_count: %d\n", *h_c);
-                insertAndAdjustLRU(cache, tag, setNum);
-                break;
-           }
-        }
-        *m_c = *m_c + 1;
-        for(i = 0; i < cache->linesPerSet; i++) {
-            if(cache->tags[setNum][i] == -1) {
-                cache->tags[setNum][i] = tag;
-                if(option == 'M') {
-                    *h_c = *h_c + 1;
-                }
-                insertAndAdjustLRU(cache, tag, setNum);
-                break;
-            }
+    if(canRunFast(sim)) {
+        runFastTrace(sim, pf);
+        fclose(pf);
+        return 0;
+    }
+    while(fgets(buf, sizeof(buf), pf) != NULL) {
+        if(!parseTraceLine(buf, &rec, label)) {
+            continue;
         }
-        *e_c = *e_c + 1;
-        for(i = 0; i < cache->linesPerSet; i++) {
-            if(cache->tags[setNum][i] == tag) {
-                if(option == 'M') {
-                    *h_c = *h_c + 1;
-                }
-                insertAndAdjustLRU(cache, tag, setNum);
-                break;
-            }
+        if(rec.op == 'R') {
+            if(rec.size) beginRegion(sim, label);
+            else endRegion(sim);
+            continue;
+        }
+        if(sim->numCores > 1 && (rec.core < 0 || rec.core >= sim->numCores)) {
+            printf("Trace names core %d but only %d cores are simulated\n", rec.core, sim->numCores);
+            fclose(pf);
+            return -1;
+        }
+        if(regions->useMarkers && rec.op != 'I' && rec.address == regions->markerStart) {
+            beginRegion(sim, NULL);
+        }
+        simulateAccess(sim, &rec);
+        if(regions->useMarkers && rec.op != 'I' && rec.address == regions->markerEnd) {
+            endRegion(sim);
         }
     }
+    fclose(pf);
     return 0;
-
 }
 
-/* 
- * Function for extracting information from the command line. 
+/*
+ * Function for extracting information from the command line.
  *
  * Uses getopt() for parsing
- * 
- * Parameters are argc and the argv array, cache info from the command line, the trace file name, and the verbose flag.
+ *
+ * Parameters are argc and the argv array, the sim to configure and the trace file name.
  * Returns 0 if no error. -1 if error.
  *
  */
-int parseCommandLine(int argc, char ** argv, int * cache_s, int * cache_E, int * cache_b, char ** traceFile, int * vflag) {
+int parseCommandLine(int argc, char ** argv, Sim * sim, char ** traceFile) {
     int c;
     int argCount = 0;
-    while((c = getopt(argc, argv, "h::v::s:E:b:t:")) != -1) {
+    int geometryCount = 0;
+    int profile = 0;
+    int iGeometrySet = 0;
+    int n, level;
+    long window = 0;
+    char * seriesFile = NULL;
+    long seriesWindow = 10000;
+    double lambda = 0;
+    while((c = getopt(argc, argv, "hvs:E:b:t:c:w:a:f:d:D:L:xkV:Cm:zr:A:I:i:T:P:o:W:p:")) != -1) {
         switch(c) {
-            case 'h': 
-                helpFlag = 1;
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
                 break;
             case 'v':
-                verboseFlag = 1; 
+                sim->verbose = 1;
                 break;
             case 's':
-                argCount++;
-                * cache_s = atoi(optarg);
+                geometryCount++;
+                sim->numSetBits = atoi(optarg);
                 break;
             case 'E':
-                argCount++;
-                * cache_E = atoi(optarg);
+                geometryCount++;
+                sim->linesPerSet = atoi(optarg);
                 break;
             case 'b':
                 argCount++;
-                * cache_b = atoi(optarg);
+                sim->numBlockBits = atoi(optarg);
                 break;
             case 't':
                 argCount++;
-                strcpy(* traceFile, optarg);
+                * traceFile = optarg;
+                break;
+            case 'c':
+                sim->numCores = atoi(optarg);
+                break;
+            case 'w':
+                if(strcmp(optarg, "wb") == 0) sim->writeThrough = 0;
+                else if(strcmp(optarg, "wt") == 0) sim->writeThrough = 1;
+                else {
+                    errorMessage();
+                    printf("Write policy must be wb or wt\n");
+                    exit(-1);
+                }
+                break;
+            case 'f':
+                if(strcmp(optarg, "none") == 0) sim->prefetchKind = PREFETCH_NONE;
+                else if(strcmp(optarg, "next") == 0) sim->prefetchKind = PREFETCH_NEXT;
+                else if(strcmp(optarg, "stride") == 0) sim->prefetchKind = PREFETCH_STRIDE;
+                else if(strcmp(optarg, "stream") == 0) sim->prefetchKind = PREFETCH_STREAM;
+                else {
+                    errorMessage();
+                    printf("Prefetcher must be none, next, stride or stream\n");
+                    exit(-1);
+                }
+                break;
+            case 'd':
+                sim->prefetchDegree = atoi(optarg);
+                break;
+            case 'D':
+                sim->prefetchDistance = atoi(optarg);
+                break;
+            case 'L':
+                sim->prefetchLatency = atoi(optarg);
+                break;
+            case 'x':
+                sim->indexHash = INDEX_XOR;
+                break;
+            case 'k':
+                sim->indexHash = INDEX_SKEW;
+                break;
+            case 'V':
+                sim->victimEntries = atoi(optarg);
+                break;
+            case 'C':
+                sim->classifyMisses = 1;
+                break;
+            case 'm':
+                if(loadMarkers(sim, optarg) != 0) {
+                    exit(-1);
+                }
+                break;
+            case 'z':
+                sim->regions.flush = 1;
+                break;
+            case 'r':
+                profile = 1;
+                window = atol(optarg);
+                break;
+            case 'A':
+                sim->addressMap = loadAddressMap(optarg);
+                if(sim->addressMap == NULL) {
+                    exit(-1);
+                }
+                break;
+            case 'I':
+                if(strcmp(optarg, "split") == 0) sim->ifetchMode = IFETCH_SPLIT;
+                else if(strcmp(optarg, "unified") == 0) sim->ifetchMode = IFETCH_UNIFIED;
+                else {
+                    errorMessage();
+                    printf("Instruction fetch mode must be split or unified\n");
+                    exit(-1);
+                }
+                break;
+            case 'i':
+                if(sscanf(optarg, "%d,%d", &sim->iSetBits, &sim->iLinesPerSet) != 2) {
+                    errorMessage();
+                    printf("L1I geometry should look like -i 4,2\n");
+                    exit(-1);
+                }
+                iGeometrySet = 1;
+                break;
+            case 'T':
+                n = sscanf(optarg, "%d,%d,%d,%d", &sim->tlbEntries[0], &sim->tlbWays[0],
+                           &sim->tlbEntries[1], &sim->tlbWays[1]);
+                if(n != 2 && n != 4) {
+                    errorMessage();
+                    printf("TLB geometry should look like -T 64,4 or -T 64,4,1536,12\n");
+                    exit(-1);
+                }
+                break;
+            case 'P':
+                if(strcmp(optarg, "4k") == 0) sim->pageBits = PAGE_BITS_4K;
+                else if(strcmp(optarg, "2m") == 0) sim->pageBits = PAGE_BITS_2M;
+                else if(strcmp(optarg, "1g") == 0) sim->pageBits = PAGE_BITS_1G;
+                else {
+                    errorMessage();
+                    printf("Page size must be 4k, 2m or 1g\n");
+                    exit(-1);
+                }
+                break;
+            case 'o':
+                seriesFile = optarg;
+                break;
+            case 'W':
+                seriesWindow = strcmp(optarg, "region") == 0 ? 0 : atol(optarg);
+                if(seriesWindow == 0 && strcmp(optarg, "region") != 0) {
+                    errorMessage();
+                    printf("Window must be a positive number of accesses or region\n");
+                    exit(-1);
+                }
+                break;
+            case 'p':
+                lambda = atof(optarg);
+                if(lambda <= 0) {
+                    errorMessage();
+                    printf("Phase threshold must be positive\n");
+                    exit(-1);
+                }
+                break;
+            case 'a':
+                if(strcmp(optarg, "wa") == 0) sim->writeAllocate = 1;
+                else if(strcmp(optarg, "nwa") == 0) sim->writeAllocate = 0;
+                else {
+                    errorMessage();
+                    printf("Allocate policy must be wa or nwa\n");
+                    exit(-1);
+                }
                 break;
             default:
                 errorMessage();
-                printf("default in switch statement in parseCommandLine\n");
                 exit(-1);
                 break;
         }
     }
-    if (argCount < 4) {
+    if (argCount < 2 || (geometryCount < 2 && !profile)) {
         errorMessage();
-        printf("argCount too low\nArgCount = %d\n", argCount);
+        printf("Missing required command line argument\n");
+        exit(-1);
+    }
+    if (profile) {
+        if (window < 0) {
+            errorMessage();
+            printf("Working set window must not be negative\n");
+            exit(-1);
+        }
+        sim->reuse = createReuseProfiler(sim->numBlockBits, (unsigned long)window);
+        sim->profileOnly = geometryCount < 2;
+        if (sim->profileOnly) {
+            sim->linesPerSet = 1;
+        }
+    }
+    if (sim->numSetBits < 0 || sim->linesPerSet <= 0 || sim->numBlockBits < 0 ||
+        sim->numBlockBits > 30 || sim->numSetBits + sim->numBlockBits > 63) {
+        errorMessage();
+        printf("Invalid cache geometry\n");
+        exit(-1);
+    }
+    if (sim->ifetchMode != IFETCH_NONE && sim->profileOnly) {
+        errorMessage();
+        printf("-I needs a cache to fetch instructions through\n");
+        exit(-1);
+    }
+    if (!iGeometrySet) {
+        sim->iSetBits = sim->numSetBits;
+        sim->iLinesPerSet = sim->linesPerSet;
+    }
+    else if (sim->ifetchMode != IFETCH_SPLIT) {
+        errorMessage();
+        printf("-i only applies to -I split\n");
+        exit(-1);
+    }
+    if (sim->iSetBits < 0 || sim->iLinesPerSet <= 0 || sim->iSetBits + sim->numBlockBits > 63) {
+        errorMessage();
+        printf("Invalid L1I geometry\n");
+        exit(-1);
+    }
+    for (level = 0; level < 2; level++) {
+        int entries = sim->tlbEntries[level];
+        int ways = sim->tlbWays[level];
+        if (entries == 0 && ways == 0) continue;
+        if (entries <= 0 || ways <= 0 || entries % ways != 0 ||
+            ((entries / ways) & (entries / ways - 1)) != 0) {
+            errorMessage();
+            printf("TLB entries must be a power of two multiple of its ways\n");
+            exit(-1);
+        }
+    }
+    if (sim->tlbEntries[0] > 0 && sim->profileOnly) {
+        errorMessage();
+        printf("-T needs a cache to translate for\n");
+        exit(-1);
+    }
+    if (seriesFile) {
+        if (sim->profileOnly || seriesWindow < 0) {
+            errorMessage();
+            printf("-o needs a cache and a positive window\n");
+            exit(-1);
+        }
+        sim->series = openSeries(seriesFile, (unsigned long)seriesWindow, lambda);
+        if (sim->series == NULL) {
+            exit(-1);
+        }
+    }
+    if (sim->addressMap && sim->profileOnly) {
+        errorMessage();
+        printf("-A needs a cache to attribute misses in\n");
+        exit(-1);
+    }
+    if (sim->profileOnly && (sim->classifyMisses || sim->indexHash != INDEX_PLAIN ||
+                             sim->victimEntries != 0 || sim->prefetchKind != PREFETCH_NONE ||
+                             sim->numCores != 1)) {
+        errorMessage();
+        printf("-C, -x, -k, -V, -f and -c need a cache to simulate\n");
+        exit(-1);
+    }
+    if (sim->numCores < 1 || sim->numCores > MAX_CORES) {
+        errorMessage();
+        printf("Number of cores must be between 1 and %d\n", MAX_CORES);
+        exit(-1);
+    }
+    if (sim->numCores > 1 && (sim->writeThrough || !sim->writeAllocate)) {
+        errorMessage();
+        printf("Coherent caches are always write-back, write-allocate\n");
+        exit(-1);
+    }
+    if (sim->prefetchDegree < 1 || sim->prefetchDegree > MAX_PREFETCH_DEGREE ||
+        sim->prefetchDistance < 1 || sim->prefetchLatency < 0) {
+        errorMessage();
+        printf("Invalid prefetch degree, distance or latency\n");
+        exit(-1);
+    }
+    if (sim->numCores > 1 && sim->prefetchKind != PREFETCH_NONE) {
+        errorMessage();
+        printf("Prefetchers are only modeled for a single cache\n");
+        exit(-1);
+    }
+    if (sim->victimEntries < 0) {
+        errorMessage();
+        printf("Victim cache size must not be negative\n");
+        exit(-1);
+    }
+    if ((sim->indexHash == INDEX_SKEW || sim->victimEntries > 0 || sim->classifyMisses) &&
+        sim->numCores > 1) {
+        errorMessage();
+        printf("-k, -V and -C are only modeled for a single cache\n");
+        exit(-1);
+    }
+    if ((sim->indexHash == INDEX_SKEW || sim->victimEntries > 0) &&
+        sim->prefetchKind != PREFETCH_NONE) {
+        errorMessage();
+        printf("-k and -V cannot be combined with a prefetcher\n");
         exit(-1);
     }
     return 0;
 }
 
+/*
+ * Sums the next-level traffic over every simulated cache.
+ */
+Traffic totalTraffic(Sim * sim) {
+    int i;
+    Traffic total;
+    memset(&total, 0, sizeof(total));
+    for(i = 0; i < sim->numCores; i++) {
+        total.dirtyEvictions += sim->caches[i]->traffic.dirtyEvictions;
+        total.bytesRead += sim->caches[i]->traffic.bytesRead;
+        total.bytesWritten += sim->caches[i]->traffic.bytesWritten;
+        if(sim->caches[i]->victimCache) {
+            Traffic * vt = &sim->caches[i]->victimCache->traffic;
+            total.dirtyEvictions += vt->dirtyEvictions;
+            total.bytesWritten += vt->bytesWritten;
+        }
+        if(sim->icaches[i]) {
+            total.bytesRead += sim->icaches[i]->traffic.bytesRead;
+        }
+    }
+    return total;
+}
+
+void printTrafficSummary(Sim * sim) {
+    Traffic total = totalTraffic(sim);
+    printf("dirty_evictions:%lu bytes_read:%lu bytes_written:%lu\n",
+           total.dirtyEvictions, total.bytesRead, total.bytesWritten);
+}
 
+/*
+ * Clears a sim and sets every option to its default.
+ */
+void initSim(Sim * sim) {
+    memset(sim, 0, sizeof(*sim));
+    sim->numCores = 1;
+    sim->writeAllocate = 1;
+    sim->prefetchDegree = 1;
+    sim->prefetchDistance = 1;
+    sim->prefetchLatency = 16;
+    sim->regions.current = -1;
+    sim->pageBits = PAGE_BITS_4K;
+}
+
+/*
+ * Creates every core's caches as the sim's options describe. A cache,
+ *  victim cache, prefetcher or per-set count that can't be allocated is
+ *  reported rather than fatal, so the server (which only builds dense
+ *  caches) can turn it into an error reply. Sparse caches still exit if
+ *  their set map can't be allocated here or their sets during the run.
+ *
+ * Returns: 0, or -1 if memory ran out (whatever was created is freed).
+ */
+int createSimCaches(Sim * sim) {
+    int i;
+    Cache * cache;
+    for(i = 0; i < sim->numCores; i++) {
+        cache = sim->caches[i] = createCache(sim->numSetBits, sim->linesPerSet, sim->numBlockBits);
+        if(cache == NULL) {
+            break;
+        }
+        cache->writeThrough = sim->writeThrough;
+        cache->writeAllocate = sim->writeAllocate;
+        cache->indexHash = sim->indexHash;
+        if(sim->indexHash != INDEX_PLAIN && sim->numCores == 1 && initSetMisses(cache) != 0) {
+            break;
+        }
+        if(sim->victimEntries > 0) {
+            cache->victimCache = createCache(0, sim->victimEntries, sim->numBlockBits);
+            if(cache->victimCache == NULL) break;
+        }
+        if(sim->prefetchKind != PREFETCH_NONE) {
+            cache->prefetcher = createPrefetcher(sim->prefetchKind, sim->prefetchDegree,
+                                                 sim->prefetchDistance, sim->prefetchLatency);
+            if(cache->prefetcher == NULL) break;
+        }
+        selectKernel(cache);
+        if(sim->ifetchMode == IFETCH_SPLIT) {
+            sim->icaches[i] = createCache(sim->iSetBits, sim->iLinesPerSet, sim->numBlockBits);
+            if(sim->icaches[i] == NULL) break;
+            selectKernel(sim->icaches[i]);
+        }
+    }
+    if(i < sim->numCores) {
+        freeSimCaches(sim);
+        return -1;
+    }
+    return 0;
+}
+
+void freeSimCaches(Sim * sim) {
+    int i;
+    for(i = 0; i < sim->numCores; i++) {
+        freeCache(sim->caches[i]);
+        freeCache(sim->icaches[i]);
+        sim->caches[i] = NULL;
+        sim->icaches[i] = NULL;
+    }
+}
 
 int main(int argc, char **argv)
 {
-    int numSetBits = 0;
-    int numLinesPerSet = 0;
-    int blockOffsetBits = 0;
-    Cache cache;
-    Cache * cacheP = &cache;
-    int hit_count = 0;
-    int miss_count = 0;
-    int eviction_count = 0;
-    FILE pf;
-    char * traceFile = malloc(20);
-    int vflag;
-    parseCommandLine(argc, argv, &numSetBits, &numLinesPerSet, &blockOffsetBits, &traceFile, &vflag);
-    cacheP = createCache(numSetBits, numLinesPerSet, blockOffsetBits);
-    parseTraceFile(&pf, &traceFile, cacheP, &hit_count, &miss_count, &eviction_count);
-    printSummary(hit_count, miss_count, eviction_count);
+    Sim sim;
+    char * traceFile = NULL;
+
+    if(argc > 2 && strcmp(argv[1], "-S") == 0) {
+        return runServer(argc, argv);
+    }
+    if(argc > 2 && strcmp(argv[1], "-q") == 0) {
+        if(runClient(argv[2], argc - 3, argv + 3) == 0) {
+            return 0;
+        }
+        //no server: simulate here with the remaining arguments
+        argv[2] = argv[0];
+        argc -= 2;
+        argv += 2;
+    }
+    initSim(&sim);
+    parseCommandLine(argc, argv, &sim, &traceFile);
+    if(!sim.profileOnly && createSimCaches(&sim) != 0) {
+        printf("Out of memory creating cache\n");
+        exit(-1);
+    }
+    if(sim.tlbEntries[0] > 0) {
+        createTlbs(&sim);
+    }
+    if(sim.numCores > 1) {
+        initCoherence(&sim);
+    }
+    if(sim.classifyMisses) {
+        initMissClassifier(&sim);
+    }
+    if(parseTraceFile(&sim, traceFile) != 0) {
+        exit(-1);
+    }
+    if(!sim.profileOnly) {
+        printSummary(sim.stats.hits, sim.stats.misses, sim.stats.evictions);
+        printTrafficSummary(&sim);
+        if(sim.ifetchMode != IFETCH_NONE) {
+            printFetchSummary(&sim);
+        }
+        if(sim.tlbEntries[0] > 0) {
+            printTlbSummary(&sim);
+        }
+        if(sim.caches[0]->prefetcher) {
+            printPrefetchSummary(sim.caches[0]);
+        }
+        if(sim.numCores == 1) {
+            printConflictSummary(&sim);
+            freeConflict(&sim);
+        }
+        if(sim.numCores > 1) {
+            printCoherenceSummary(&sim);
+            freeCoherence(&sim);
+        }
+        if(sim.addressMap) {
+            printAttribution(sim.addressMap, sim.verbose);
+        }
+        closeSeries(&sim);
+    }
+    if(sim.reuse) {
+        printReuseHistogram("", &sim.reuse->total, sim.reuse);
+    }
+    if(sim.regions.count > 0 || sim.regions.useMarkers) {
+        printRegionSummary(&sim);
+    }
+    freeRegions(&sim);
+    freeReuseProfiler(sim.reuse);
+    freeAddressMap(sim.addressMap);
+    freeTlbs(&sim);
+    freeSimCaches(&sim);
     return 0;
 }
@@ -0,0 +1,487 @@
+/*
+ * csim.h - Types shared by the cache simulator modules
+ *
+ * David O'Keefe -- okeefed@appstate.edu
+ * Steve Lewis -- lewissj@appstate.edu
+ *
+ */
+
+#ifndef CSIM_H
+#define CSIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Largest number of private caches the coherent mode will simulate */
+#define MAX_CORES 16
+
+/* Prefetcher models (csim -f) */
+#define PREFETCH_NONE   0
+#define PREFETCH_NEXT   1
+#define PREFETCH_STRIDE 2
+#define PREFETCH_STREAM 3
+
+#define MAX_PREFETCH_DEGREE 16
+#define STRIDE_TABLE_SIZE 64        //entries, indexed by 4KB region
+#define STRIDE_REGION_BITS 12
+#define NUM_STREAM_BUFFERS 4
+#define POLLUTION_FILTER_SIZE 4096  //blocks recently evicted by a prefetch
+
+/* Set selection (csim -x, -k) */
+#define INDEX_PLAIN 0       //bit slice above the block offset
+#define INDEX_XOR   1       //every s-bit chunk of the block address XORed together
+#define INDEX_SKEW  2       //a different hash per way
+
+/* Instruction fetch modeling (csim -I) */
+#define IFETCH_NONE    0    //I records are skipped, as csim-ref does
+#define IFETCH_SPLIT   1    //separate L1I per core
+#define IFETCH_UNIFIED 2    //fetches go through the data cache
+
+/* Data TLB (csim -T, -P); a page walk costs one memory reference per
+ *  page table level, 4 for 4KB pages, 3 for 2MB and 2 for 1GB */
+#define PAGE_BITS_4K 12
+#define PAGE_BITS_2M 21
+#define PAGE_BITS_1G 30
+
+/* Outcome of one translation */
+#define TLB_L1_HIT 0
+#define TLB_L2_HIT 1
+#define TLB_WALK   2
+
+/* Caches of up to DENSE_CACHE_LINES lines store every set up front; larger
+ *  ones give a set storage from an arena the first time it is touched */
+#define DENSE_CACHE_LINES (1 << 16)
+#define ARENA_CHUNK_LINES 4096
+
+#define REGION_LABEL_MAX 64
+
+#define MAX_MAPPED_ARRAYS 15
+#define ARRAY_NAME_MAX 16
+#define TOP_EVICTION_PAIRS 10
+
+/* Reuse distance buckets: 0, 1, 2-3, 4-7, ..., 2^39 and up */
+#define REUSE_BUCKETS 41
+
+/* Result flags returned by a single cache access */
+#define ACCESS_HIT   0x1
+#define ACCESS_MISS  0x2
+#define ACCESS_EVICT 0x4
+
+/*
+ * MESI line states. A single private cache only ever uses I, E and M
+ * (M meaning the line has been written since it was filled).
+ */
+typedef enum {
+    STATE_I = 0,
+    STATE_S,
+    STATE_E,
+    STATE_M
+} LineState;
+
+typedef struct {
+    uint64_t tag;       //block address (address >> b)
+    int state;          //LineState; STATE_I means the line is empty
+    int stale;          //line was invalidated by another core's write
+    int prefetched;     //filled by a prefetch and not yet used by a demand access
+    unsigned long readyAt;  //prefetcher clock at which a prefetched line arrives
+    unsigned long lastUse;  //cache clock of the last access, skewed mode only
+} Line;
+
+/* Next-level traffic caused by one cache */
+typedef struct {
+    unsigned long dirtyEvictions;
+    unsigned long bytesRead;        //line fills
+    unsigned long bytesWritten;     //write-backs and write-through stores
+} Traffic;
+
+typedef struct {
+    unsigned long issued;
+    unsigned long useful;       //prefetched lines used before being evicted
+    unsigned long late;         //useful, but used before the prefetch arrived
+    unsigned long useless;      //prefetched lines evicted without being used
+    unsigned long polluting;    //demand misses on lines a prefetch pushed out
+    unsigned long evictions;    //valid lines evicted by prefetch fills
+} PrefetchStats;
+
+typedef struct {
+    int valid;
+    uint64_t region;
+    uint64_t lastBlock;
+    int64_t stride;
+    int confidence;
+} StrideEntry;
+
+typedef struct {
+    int valid;
+    int head;
+    int count;
+    uint64_t nextBlock;         //next block to fetch into the tail
+    unsigned long lastUse;
+    uint64_t blocks[MAX_PREFETCH_DEGREE];
+    unsigned long readyAt[MAX_PREFETCH_DEGREE];
+} StreamBuffer;
+
+typedef struct {
+    int kind;                   //PREFETCH_*
+    int degree;                 //blocks fetched per trigger (stream buffer depth)
+    int distance;               //how many blocks ahead the first prefetch lands
+    int latency;                //accesses between issuing a prefetch and its arrival
+    unsigned long clock;        //demand accesses seen so far
+    StrideEntry strideTable[STRIDE_TABLE_SIZE];
+    StreamBuffer buffers[NUM_STREAM_BUFFERS];
+    uint64_t pollutionFilter[POLLUTION_FILTER_SIZE];   //block + 1, 0 when empty
+    PrefetchStats stats;
+} Prefetcher;
+
+/*
+ * Small open-addressing hash map from a 64 bit block address to a
+ *  caller defined size_t value (usually an index into a side array).
+ */
+typedef struct {
+    uint64_t * keys;
+    size_t * values;
+    unsigned char * used;
+    size_t capacity;
+    size_t count;
+} BlockMap;
+
+typedef struct {
+    unsigned long victimHits;       //misses caught by the victim cache
+    unsigned long victimInserts;    //lines moved into the victim cache
+    int countSets;                  //misses per set are kept (-x and -k)
+    unsigned long * setMisses;      //per set, for dense caches
+    BlockMap setMissMap;            //set -> misses, for sparse caches
+} ConflictStats;
+
+typedef struct Cache {
+    uint64_t numSets;
+    int numSetBits;
+    int linesPerSet;
+    int numBlockBits;
+    int blockSize;
+    int numTagBits;
+    int writeThrough;   //stores go straight to the next level; lines never dirty
+    int writeAllocate;  //store misses fill the line
+    Traffic traffic;
+    uint64_t lastVictim;        //block evicted by the most recent demand fill
+    Prefetcher * prefetcher;    //NULL when prefetching is off
+    int indexHash;              //INDEX_*
+    unsigned long clock;        //accesses so far, skewed mode only
+    struct Cache * victimCache; //fully associative, NULL when off
+    ConflictStats conflict;
+    //Set storage. getSet(c, n)[0] is set n's most recently used line
+    //(in skewed mode getSet(c, h_w(block))[w] is way w's line).
+    Line * dense;       //every set back to back; NULL for a sparse cache
+    BlockMap setMap;    //sparse: set number -> order the set was first touched
+    Line ** chunks;     //sparse: arena of zeroed sets, setsPerChunk in each
+    size_t numChunks;
+    size_t setsPerChunk;
+    size_t setsStored;  //sets given storage so far
+    //specialized accessCache for this geometry, NULL for the generic path
+    int (*kernel)(struct Cache * cache, uint64_t address, int isWrite);
+} Cache;
+
+
+/*
+ * A private data TLB. Each level is a Cache whose "blocks" are pages, so
+ *  lookups and LRU replacement are the cache's own.
+ */
+typedef struct {
+    Cache * l1;
+    Cache * l2;                 //NULL with a single level
+    unsigned long l1Hits;
+    unsigned long l1Misses;
+    unsigned long l2Hits;
+    unsigned long walks;        //misses in every level
+    unsigned long walkRefs;     //page table references made by the walks
+} Tlb;
+
+/* One decoded line of a trace file */
+typedef struct {
+    char op;            //'L', 'S', 'M', 'I', or 'R' for a region record
+    uint64_t address;
+    int size;           //for 'R': 1 begins a region, 0 ends it
+    int core;           //optional trailing field, 0 when absent
+} TraceRecord;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+} Stats;
+
+typedef struct {
+    uint64_t touched[MAX_CORES];    //byte masks per core, one bit per byte (or chunk)
+    uint64_t written[MAX_CORES];
+    unsigned long invalidations;
+} SharingInfo;
+
+typedef struct {
+    unsigned long invalidations;    //remote copies killed by a write
+    unsigned long coherenceMisses;  //misses on a line another core invalidated
+    unsigned long upgrades;         //S -> M transitions on a write hit
+    unsigned long interventions;    //M copies supplied to another core's read
+    BlockMap sharingMap;            //block -> index into sharing
+    SharingInfo * sharing;
+    size_t sharingCapacity;
+} Coherence;
+
+/* One line of the classifier's fully associative shadow cache */
+typedef struct {
+    uint64_t block;
+    size_t prev;                //toward the most recently used line
+    size_t next;
+} ShadowLine;
+
+/* Sorts misses into cold, capacity and conflict (csim -C) */
+typedef struct {
+    ShadowLine * shadow;        //fully associative LRU cache of the same size
+    size_t shadowAllocated;
+    size_t shadowUsed;
+    uint64_t shadowLines;       //lines in the real cache
+    size_t mru;
+    size_t lru;
+    int numBlockBits;
+    int writeAllocate;
+    BlockMap seen;              //every block referenced so far -> its shadow line + 1, 0 if not resident
+    unsigned long cold;
+    unsigned long capacity;
+    unsigned long conflict;
+} MissClassifier;
+
+/* Reuse distance histogram and working set summary for part of a trace */
+typedef struct {
+    unsigned long cold;                     //first touch of a block
+    unsigned long buckets[REUSE_BUCKETS];   //distinct blocks between reuses
+    unsigned long wsSamples;
+    unsigned long wsMax;                    //blocks touched in one window
+    double wsSum;
+} ReuseHistogram;
+
+/*
+ * LRU stack distances at block granularity (csim -r). Every access gets a
+ *  position; a Fenwick tree over the positions holds a 1 at each block's
+ *  most recent access, so the reuse distance of a block last seen at
+ *  position p is the number of 1s after p. Positions are renumbered when
+ *  they run out, which keeps memory proportional to the distinct blocks.
+ */
+typedef struct {
+    BlockMap lastPos;           //block -> position of its last access
+    uint32_t * tree;            //Fenwick tree, 1-based
+    unsigned char * live;       //position holds some block's last access
+    uint64_t * blockAt;         //block accessed at each position
+    unsigned long * timeAt;     //access number at each position
+    size_t capacity;
+    size_t next;                //next free position
+    unsigned long time;         //accesses profiled so far
+    int numBlockBits;
+    unsigned long window;       //working set window in accesses, 0 for none
+    ReuseHistogram total;
+} ReuseProfiler;
+
+typedef struct {
+    char label[REGION_LABEL_MAX];
+    Stats stats;
+    Stats ifetch;
+    unsigned long pageWalks;
+    ReuseHistogram reuse;
+} Region;
+
+/*
+ * Regions of interest, bounded either by accesses to the two marker
+ *  addresses tracegen records in .marker or by "R begin <label>" and
+ *  "R end" lines in the trace.
+ */
+typedef struct {
+    Region * list;
+    int count;
+    int capacity;
+    int current;                //index into list, -1 outside any region
+    int useMarkers;
+    uint64_t markerStart;
+    uint64_t markerEnd;
+    int flush;                  //empty the caches whenever a region begins
+} Regions;
+
+/* One array from tracegen's .addrmap sidecar */
+typedef struct {
+    char name[ARRAY_NAME_MAX];
+    uint64_t base;
+    int rows;
+    int cols;
+    int elemSize;
+    unsigned long * misses;     //rows * cols counts, row major
+    unsigned long * evictions;
+} MappedArray;
+
+/* Attribution of misses and evictions to array elements (csim -A) */
+typedef struct {
+    MappedArray arrays[MAX_MAPPED_ARRAYS];
+    int count;
+    BlockMap pairs;             //element pair -> evictions between them
+    unsigned long otherMisses;  //accesses outside every array
+    unsigned long otherEvictions;
+} AddressMap;
+
+/*
+ * Streams counts for every window of accesses (or every region) to a CSV
+ *  or JSON Lines file, with an optional Page-Hinkley test on the miss
+ *  rate to flag phase changes (csim -o, -W, -p).
+ */
+typedef struct {
+    FILE * out;
+    int json;
+    unsigned long window;       //accesses per row, 0 for one row per region
+    unsigned long rows;
+    unsigned long accesses;     //accesses so far, rows included
+    Stats start;                //sim->stats when the current window began
+    unsigned long startAccess;
+    double lambda;              //detection threshold, 0 when detection is off
+    double delta;               //drift tolerated without flagging a change
+    unsigned long samples;      //rows since the last change
+    double mean;
+    double upSum, upMin;        //cumulative deviations for a rise ...
+    double downSum, downMax;    //... and for a fall in miss rate
+    int phase;
+    unsigned long changes;
+} Series;
+
+/* Everything one simulation run needs; nothing in here is global */
+typedef struct {
+    int numSetBits;
+    int linesPerSet;
+    int numBlockBits;
+    int numCores;
+    int verbose;
+    int writeThrough;
+    int writeAllocate;
+    int prefetchKind;
+    int prefetchDegree;
+    int prefetchDistance;
+    int prefetchLatency;
+    int indexHash;
+    int victimEntries;
+    int classifyMisses;
+    int profileOnly;            //-r without -s/-E: no cache is simulated
+    int ifetchMode;
+    int iSetBits;               //L1I geometry when split
+    int iLinesPerSet;
+    Cache * caches[MAX_CORES];
+    Cache * icaches[MAX_CORES]; //NULL unless split
+    int tlbEntries[2];          //L1 and L2 TLB entries, 0 for no level
+    int tlbWays[2];
+    int pageBits;
+    Tlb tlbs[MAX_CORES];        //l1 is NULL unless csim -T
+    Stats stats;
+    Stats coreStats[MAX_CORES];
+    Stats ifetchStats;
+    Coherence coherence;
+    MissClassifier classifier;
+    Regions regions;
+    ReuseProfiler * reuse;      //NULL unless csim -r
+    AddressMap * addressMap;    //NULL unless csim -A
+    Series * series;            //NULL unless csim -o
+} Sim;
+
+//csim.c
+Cache * createCache(int numSetBits, int linesPerSet, int numBlockBits);
+void freeCache(Cache * cache);
+uint64_t getSetIndex(Cache * cache, uint64_t block);
+Line * getSet(Cache * cache, uint64_t setNum);
+Line * getStoredSet(Cache * cache, size_t k);
+int findDuplicateTag(Cache * cache, uint64_t tag, uint64_t setNum);
+int findEmptyLine(Cache * cache, uint64_t setNum);
+void insertAndAdjustLRU(Cache * cache, uint64_t setNum, int index);
+int fillLine(Cache * cache, uint64_t tag, uint64_t setNum, int state, Line * victim);
+int accessCache(Cache * cache, uint64_t address, int size, int isWrite);
+void flushCache(Cache * cache);
+int parseTraceLine(const char * buf, TraceRecord * rec, char * label);
+void simulateAccess(Sim * sim, const TraceRecord * rec);
+void initSim(Sim * sim);
+int createSimCaches(Sim * sim);
+void freeSimCaches(Sim * sim);
+Traffic totalTraffic(Sim * sim);
+void printTrafficSummary(Sim * sim);
+
+//blockmap.c
+void blockMapInit(BlockMap * map, size_t capacity);
+void blockMapFree(BlockMap * map);
+size_t * blockMapFind(BlockMap * map, uint64_t key);
+size_t * blockMapInsert(BlockMap * map, uint64_t key, int * created);
+
+//prefetch.c
+Prefetcher * createPrefetcher(int kind, int degree, int distance, int latency);
+int prefetchHit(Cache * cache, Line * line);
+int streamBufferLookup(Cache * cache, uint64_t block);
+void prefetchNoteMiss(Cache * cache, uint64_t block);
+void prefetchNoteEviction(Cache * cache, const Line * victim, int byPrefetch);
+void prefetchTrain(Cache * cache, uint64_t block, int miss, int firstUse);
+void printPrefetchSummary(Cache * cache);
+
+//conflict.c
+uint64_t hashSetIndex(Cache * cache, uint64_t block);
+int victimLookup(Cache * cache, uint64_t block, int * state);
+int victimInsert(Cache * cache, const Line * victim);
+int skewedAccess(Cache * cache, uint64_t address, int size, int isWrite);
+int initSetMisses(Cache * cache);
+void countSetMiss(Cache * cache, uint64_t setNum);
+void initMissClassifier(Sim * sim);
+void resetMissClassifier(Sim * sim);
+void classifyAccess(Sim * sim, uint64_t address, int size, int isWrite, int result);
+void printConflictSummary(Sim * sim);
+void freeConflict(Sim * sim);
+
+//regions.c
+int loadMarkers(Sim * sim, const char * markerFile);
+void beginRegion(Sim * sim, const char * label);
+void endRegion(Sim * sim);
+void printRegionSummary(Sim * sim);
+void freeRegions(Sim * sim);
+
+//reuse.c
+ReuseProfiler * createReuseProfiler(int numBlockBits, unsigned long window);
+void resetReuseProfiler(ReuseProfiler * rp);
+void freeReuseProfiler(ReuseProfiler * rp);
+void reuseAccess(Sim * sim, uint64_t address);
+void printReuseHistogram(const char * label, const ReuseHistogram * hist, const ReuseProfiler * rp);
+
+//fastpath.c
+void selectKernel(Cache * cache);
+int canRunFast(const Sim * sim);
+int runFastTrace(Sim * sim, FILE * fp);
+
+//daemon.c
+int runServer(int argc, char ** argv);
+int runClient(const char * socketPath, int argc, char ** argv);
+
+//series.c
+Series * openSeries(const char * path, unsigned long window, double lambda);
+void seriesAccess(Sim * sim);
+void seriesRegionEnd(Sim * sim, const Region * region);
+void closeSeries(Sim * sim);
+
+//ifetch.c
+void simulateFetch(Sim * sim, const TraceRecord * rec);
+void printFetchSummary(Sim * sim);
+
+//tlb.c
+void createTlbs(Sim * sim);
+int translate(Sim * sim, int core, uint64_t address);
+void flushTlb(Tlb * tlb);
+void printTlbSummary(Sim * sim);
+void freeTlbs(Sim * sim);
+
+//attrib.c
+AddressMap * loadAddressMap(const char * mapFile);
+void attributeAccess(AddressMap * map, Cache * cache, uint64_t address, int result);
+void printAttribution(AddressMap * map, int verbose);
+void freeAddressMap(AddressMap * map);
+
+//coherence.c
+void initCoherence(Sim * sim);
+void freeCoherence(Sim * sim);
+int coherentAccess(Sim * sim, int core, uint64_t address, int size, int isWrite);
+void printCoherenceSummary(Sim * sim);
+
+#endif /* CSIM_H */
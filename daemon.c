@@ -0,0 +1,595 @@
+/*
+ * daemon.c - Resident simulation server and its client
+ *
+ *  csim -S <socket> [-j <threads>] [-M <megabytes>]
+ *      listens on a Unix domain socket and answers simulate requests
+ *      from a pool of <threads> workers (default 4). Decoded traces stay
+ *      in memory, keyed by path, inode, modification time (to the
+ *      nanosecond) and size, and the least recently used ones are dropped
+ *      once they take more than <megabytes> (default 256), so each trace
+ *      is parsed once while it stays warm.
+ *
+ *  csim -q <socket> <usual options>
+ *      sends the run to the server and prints the same output, including
+ *      .csim_results, as running csim directly. If no server is listening
+ *      or it can't handle an option, csim simply runs locally.
+ *
+ * A request is one line of options, e.g. "-s 4 -E 1 -b 4 -t /abs/yi.trace",
+ *  with a relative trace path taken relative to the server's directory
+ *  (the client sends absolute paths). The server handles -s, -E, -b, -t,
+ *  -w and -a for caches of up to DENSE_CACHE_LINES (64K) lines, which are
+ *  allocated whole before the run starts; anything else gets
+ *  "unsupported" and runs in the client, where running out of memory
+ *  can't take the shared server down. Replies are "ok <hits> <misses>
+ *  <evictions>" followed by the traffic line, or "error <message>".
+ *  The request "stats" reports the trace cache.
+ */
+#define _XOPEN_SOURCE 700
+#include "csim.h"
+#include "cachelab.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 64
+#define REQUEST_MAX 4096
+#define REPLY_MAX 1024
+#define PENDING_MAX 64      //accepted connections waiting for a worker
+
+/* A trace decoded into records, shared read-only by every run using it */
+typedef struct DecodedTrace {
+    char * path;
+    dev_t device;
+    ino_t inode;
+    struct timespec mtime;      //to the nanosecond, so a rewrite within a second shows
+    off_t size;
+    TraceRecord * records;      //data accesses only
+    size_t count;
+    size_t bytes;
+    int refs;                   //runs using it; never dropped while nonzero
+    struct DecodedTrace * prev; //LRU list, most recently used first
+    struct DecodedTrace * next;
+} DecodedTrace;
+
+typedef struct {
+    pthread_mutex_t lock;
+    DecodedTrace * head;
+    DecodedTrace * tail;
+    int count;
+    size_t bytes;
+    size_t limit;
+    unsigned long hits;         //requests served from memory
+    unsigned long loads;        //traces read and decoded
+} TraceCache;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    int pending[PENDING_MAX];
+    int first;
+    int count;
+    TraceCache traces;
+} Server;
+
+static void freeTrace(DecodedTrace * trace) {
+    free(trace->path);
+    free(trace->records);
+    free(trace);
+}
+
+/*
+ * Reads and decodes a whole trace.
+ *
+ * Returns: the trace with refs 0, or NULL if the file can't be read or
+ *          memory runs out.
+ */
+static DecodedTrace * decodeTrace(const char * path, const struct stat * st) {
+    char buf[256];
+    char label[REGION_LABEL_MAX];
+    TraceRecord rec;
+    size_t capacity = 1024;
+    DecodedTrace * trace;
+    FILE * fp = fopen(path, "r");
+
+    if(!fp) {
+        return NULL;
+    }
+    //running out of memory fails this request, not the whole server
+    trace = calloc(1, sizeof(*trace));
+    if(trace == NULL || (trace->path = strdup(path)) == NULL ||
+       (trace->records = malloc(capacity * sizeof(TraceRecord))) == NULL) {
+        if(trace) freeTrace(trace);
+        fclose(fp);
+        return NULL;
+    }
+    while(fgets(buf, sizeof(buf), fp) != NULL) {
+        if(!parseTraceLine(buf, &rec, label) || rec.op == 'I' || rec.op == 'R') {
+            continue;
+        }
+        if(trace->count == capacity) {
+            TraceRecord * grown = realloc(trace->records, 2 * capacity * sizeof(TraceRecord));
+            if(grown == NULL) {
+                freeTrace(trace);
+                fclose(fp);
+                return NULL;
+            }
+            trace->records = grown;
+            capacity *= 2;
+        }
+        trace->records[trace->count++] = rec;
+    }
+    fclose(fp);
+    if(trace->count > 0 && trace->count < capacity) {
+        //give back the slack from doubling; the trace may stay cached a long time
+        TraceRecord * fitted = realloc(trace->records, trace->count * sizeof(TraceRecord));
+        if(fitted) {
+            trace->records = fitted;
+            capacity = trace->count;
+        }
+    }
+    trace->device = st->st_dev;
+    trace->inode = st->st_ino;
+    trace->mtime = st->st_mtim;
+    trace->size = st->st_size;
+    trace->bytes = sizeof(*trace) + capacity * sizeof(TraceRecord);
+    return trace;
+}
+
+static void unlinkTrace(TraceCache * tc, DecodedTrace * trace) {
+    if(trace->prev) trace->prev->next = trace->next;
+    else tc->head = trace->next;
+    if(trace->next) trace->next->prev = trace->prev;
+    else tc->tail = trace->prev;
+    trace->prev = trace->next = NULL;
+    tc->bytes -= trace->bytes;
+    tc->count--;
+}
+
+static void pushFront(TraceCache * tc, DecodedTrace * trace) {
+    trace->prev = NULL;
+    trace->next = tc->head;
+    if(tc->head) tc->head->prev = trace;
+    else tc->tail = trace;
+    tc->head = trace;
+    tc->bytes += trace->bytes;
+    tc->count++;
+}
+
+/*
+ * Drops unused traces, least recently used first, until the cache fits
+ *  its limit. Caller holds the lock.
+ */
+static void trimTraces(TraceCache * tc) {
+    DecodedTrace * trace = tc->tail;
+    while(trace && tc->bytes > tc->limit) {
+        DecodedTrace * prev = trace->prev;
+        if(trace->refs == 0) {
+            unlinkTrace(tc, trace);
+            freeTrace(trace);
+        }
+        trace = prev;
+    }
+}
+
+/*
+ * Finds the current version of a trace in the cache, dropping any unused
+ *  entry for an older version of the file. Caller holds the lock.
+ */
+static DecodedTrace * findTrace(TraceCache * tc, const char * path, const struct stat * st) {
+    DecodedTrace * trace = tc->head;
+    while(trace) {
+        DecodedTrace * next = trace->next;
+        if(strcmp(trace->path, path) == 0) {
+            if(trace->device == st->st_dev && trace->inode == st->st_ino &&
+               trace->mtime.tv_sec == st->st_mtim.tv_sec &&
+               trace->mtime.tv_nsec == st->st_mtim.tv_nsec && trace->size == st->st_size) {
+                return trace;
+            }
+            if(trace->refs == 0) {
+                unlinkTrace(tc, trace);
+                freeTrace(trace);
+            }
+        }
+        trace = next;
+    }
+    return NULL;
+}
+
+/*
+ * Returns the decoded trace for a path, reading it if it isn't cached or
+ *  the file changed. The caller must hand it back with releaseTrace.
+ *
+ * Returns: the trace, or NULL if the file can't be read.
+ */
+static DecodedTrace * acquireTrace(TraceCache * tc, const char * path) {
+    struct stat st;
+    DecodedTrace * trace;
+    DecodedTrace * loaded;
+
+    if(stat(path, &st) != 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&tc->lock);
+    trace = findTrace(tc, path, &st);
+    if(trace) {
+        tc->hits++;
+        trace->refs++;
+        unlinkTrace(tc, trace);
+        pushFront(tc, trace);
+        pthread_mutex_unlock(&tc->lock);
+        return trace;
+    }
+    pthread_mutex_unlock(&tc->lock);
+
+    //decode without the lock so other requests aren't held up
+    loaded = decodeTrace(path, &st);
+    if(loaded == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&tc->lock);
+    trace = findTrace(tc, path, &st);
+    if(trace) {
+        //another worker got there first
+        freeTrace(loaded);
+        unlinkTrace(tc, trace);
+    }
+    else {
+        trace = loaded;
+        tc->loads++;
+    }
+    trace->refs++;
+    pushFront(tc, trace);
+    trimTraces(tc);
+    pthread_mutex_unlock(&tc->lock);
+    return trace;
+}
+
+static void releaseTrace(TraceCache * tc, DecodedTrace * trace) {
+    pthread_mutex_lock(&tc->lock);
+    trace->refs--;
+    trimTraces(tc);
+    pthread_mutex_unlock(&tc->lock);
+}
+
+/*
+ * Reads options from a request into a sim, checking them the way
+ *  parseCommandLine does.
+ *
+ * Returns: the trace path, or NULL with reply holding the answer.
+ */
+static char * parseRequest(char * request, Sim * sim, char * reply) {
+    char * save = NULL;
+    char * opt;
+    char * arg;
+    char * traceFile = NULL;
+    int required = 0;
+
+    for(opt = strtok_r(request, " \t\r\n", &save); opt; opt = strtok_r(NULL, " \t\r\n", &save)) {
+        arg = strtok_r(NULL, " \t\r\n", &save);
+        if(arg == NULL || opt[0] != '-' || strlen(opt) != 2) {
+            strcpy(reply, "unsupported\n");
+            return NULL;
+        }
+        switch(opt[1]) {
+            case 's': sim->numSetBits = atoi(arg); required |= 1; break;
+            case 'E': sim->linesPerSet = atoi(arg); required |= 2; break;
+            case 'b': sim->numBlockBits = atoi(arg); required |= 4; break;
+            case 't': traceFile = arg; required |= 8; break;
+            case 'w':
+                if(strcmp(arg, "wb") == 0) sim->writeThrough = 0;
+                else if(strcmp(arg, "wt") == 0) sim->writeThrough = 1;
+                else {
+                    strcpy(reply, "error Write policy must be wb or wt\n");
+                    return NULL;
+                }
+                break;
+            case 'a':
+                if(strcmp(arg, "wa") == 0) sim->writeAllocate = 1;
+                else if(strcmp(arg, "nwa") == 0) sim->writeAllocate = 0;
+                else {
+                    strcpy(reply, "error Allocate policy must be wa or nwa\n");
+                    return NULL;
+                }
+                break;
+            default:
+                strcpy(reply, "unsupported\n");
+                return NULL;
+        }
+    }
+    if(required != 15) {
+        strcpy(reply, "error Missing required command line argument\n");
+        return NULL;
+    }
+    if(sim->numSetBits < 0 || sim->linesPerSet <= 0 || sim->numBlockBits < 0 ||
+       sim->numBlockBits > 30 || sim->numSetBits + sim->numBlockBits > 63) {
+        strcpy(reply, "error Invalid cache geometry\n");
+        return NULL;
+    }
+    //only a dense cache is allocated whole up front; a sparse one allocates
+    //(and exits if it can't) mid-run, which would take every client down
+    if(sim->numSetBits > 16 || ((uint64_t)sim->linesPerSet << sim->numSetBits) > DENSE_CACHE_LINES) {
+        strcpy(reply, "unsupported\n");
+        return NULL;
+    }
+    return traceFile;
+}
+
+/*
+ * Answers one request on a connected socket, then closes it.
+ */
+static void handleRequest(Server * server, int fd) {
+    char request[REQUEST_MAX];
+    char reply[REPLY_MAX];
+    size_t used = 0;
+    ssize_t n;
+    size_t i;
+    Sim sim;
+    char * traceFile;
+    DecodedTrace * trace;
+    Traffic traffic;
+
+    while(used < sizeof(request) - 1 && (n = read(fd, request + used, sizeof(request) - 1 - used)) > 0) {
+        used += n;
+        if(memchr(request, '\n', used)) break;
+    }
+    request[used] = '\0';
+
+    if(strncmp(request, "stats", 5) == 0) {
+        TraceCache * tc = &server->traces;
+        pthread_mutex_lock(&tc->lock);
+        snprintf(reply, sizeof(reply), "ok traces:%d bytes:%lu limit:%lu trace_hits:%lu trace_loads:%lu\n",
+                 tc->count, (unsigned long)tc->bytes, (unsigned long)tc->limit, tc->hits, tc->loads);
+        pthread_mutex_unlock(&tc->lock);
+    }
+    else {
+        initSim(&sim);
+        traceFile = parseRequest(request, &sim, reply);
+        if(traceFile) {
+            trace = acquireTrace(&server->traces, traceFile);
+            if(trace == NULL) {
+                strcpy(reply, "error Can't open trace file\n");
+            }
+            else if(createSimCaches(&sim) != 0) {
+                strcpy(reply, "error Out of memory creating cache\n");
+                releaseTrace(&server->traces, trace);
+            }
+            else {
+                for(i = 0; i < trace->count; i++) {
+                    simulateAccess(&sim, &trace->records[i]);
+                }
+                traffic = totalTraffic(&sim);
+                snprintf(reply, sizeof(reply),
+                         "ok %lu %lu %lu\ndirty_evictions:%lu bytes_read:%lu bytes_written:%lu\n",
+                         sim.stats.hits, sim.stats.misses, sim.stats.evictions,
+                         traffic.dirtyEvictions, traffic.bytesRead, traffic.bytesWritten);
+                freeSimCaches(&sim);
+                releaseTrace(&server->traces, trace);
+            }
+        }
+    }
+    used = strlen(reply);
+    for(i = 0; i < used; i += n) {
+        n = write(fd, reply + i, used - i);
+        if(n <= 0) break;
+    }
+    close(fd);
+}
+
+/*
+ * Makes sure the socket path is free to bind. Only a socket nobody is
+ *  listening on is removed; a live server's socket or any other file is
+ *  left alone.
+ *
+ * Returns: 0 if the path can be bound, -1 (with a message) otherwise.
+ */
+static int clearStaleSocket(const struct sockaddr_un * addr) {
+    struct stat st;
+    int fd, result;
+    if(lstat(addr->sun_path, &st) != 0) {
+        return 0;
+    }
+    if(!S_ISSOCK(st.st_mode)) {
+        printf("%s exists and is not a socket\n", addr->sun_path);
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) {
+        printf("Can't check %s\n", addr->sun_path);
+        return -1;
+    }
+    //refused means the socket was left behind by a server that is gone
+    result = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0 ? 0 : errno;
+    close(fd);
+    if(result == 0) {
+        printf("A server is already listening on %s\n", addr->sun_path);
+        return -1;
+    }
+    if(result != ECONNREFUSED) {
+        printf("Can't check %s\n", addr->sun_path);
+        return -1;
+    }
+    unlink(addr->sun_path);
+    return 0;
+}
+
+static void * workerMain(void * arg) {
+    Server * server = arg;
+    int fd;
+    for(;;) {
+        pthread_mutex_lock(&server->lock);
+        while(server->count == 0) {
+            pthread_cond_wait(&server->notEmpty, &server->lock);
+        }
+        fd = server->pending[server->first];
+        server->first = (server->first + 1) % PENDING_MAX;
+        server->count--;
+        pthread_cond_signal(&server->notFull);
+        pthread_mutex_unlock(&server->lock);
+        handleRequest(server, fd);
+    }
+    return NULL;
+}
+
+/*
+ * Runs the server until it is killed.
+ *
+ * Params: the full command line, starting "csim -S <socket>".
+ * Returns: only on a setup error, with -1.
+ */
+int runServer(int argc, char ** argv) {
+    int c, i, fd, listener;
+    int workers = 4;
+    long megabytes = 256;
+    char * socketPath = NULL;
+    struct sockaddr_un addr;
+    pthread_t thread;
+    Server * server;
+
+    while((c = getopt(argc, argv, "S:j:M:")) != -1) {
+        switch(c) {
+            case 'S': socketPath = optarg; break;
+            case 'j': workers = atoi(optarg); break;
+            case 'M': megabytes = atol(optarg); break;
+            default:
+                printf("Usage: %s -S <socket> [-j <threads>] [-M <megabytes>]\n", argv[0]);
+                return -1;
+        }
+    }
+    if(workers < 1 || workers > MAX_WORKERS || megabytes < 1) {
+        printf("Threads must be between 1 and %d and the trace cache at least 1MB\n", MAX_WORKERS);
+        return -1;
+    }
+    if(strlen(socketPath) >= sizeof(addr.sun_path)) {
+        printf("Socket path is too long\n");
+        return -1;
+    }
+
+    server = calloc(1, sizeof(*server));
+    if(server == NULL) {
+        printf("Out of memory in runServer\n");
+        return -1;
+    }
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->notEmpty, NULL);
+    pthread_cond_init(&server->notFull, NULL);
+    pthread_mutex_init(&server->traces.lock, NULL);
+    server->traces.limit = (size_t)megabytes << 20;
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+    if(clearStaleSocket(&addr) != 0) {
+        return -1;
+    }
+    if(listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+       listen(listener, PENDING_MAX) != 0) {
+        printf("Can't listen on %s\n", socketPath);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);   //a client hanging up mustn't kill the server
+    for(i = 0; i < workers; i++) {
+        if(pthread_create(&thread, NULL, workerMain, server) != 0) {
+            printf("Can't start worker threads\n");
+            return -1;
+        }
+        pthread_detach(thread);
+    }
+    printf("csim server on %s: %d threads, %ldMB trace cache\n", socketPath, workers, megabytes);
+    fflush(stdout);
+
+    for(;;) {
+        fd = accept(listener, NULL, NULL);
+        if(fd < 0) continue;
+        pthread_mutex_lock(&server->lock);
+        while(server->count == PENDING_MAX) {
+            pthread_cond_wait(&server->notFull, &server->lock);
+        }
+        server->pending[(server->first + server->count) % PENDING_MAX] = fd;
+        server->count++;
+        pthread_cond_signal(&server->notEmpty);
+        pthread_mutex_unlock(&server->lock);
+    }
+    return 0;
+}
+
+/*
+ * Sends a run to the server and prints its answer as csim would.
+ *
+ * Params: socket path, the options after "-q <socket>".
+ * Returns: 0 once the output is printed, -1 if the run should happen
+ *          locally instead (no server, or an option it doesn't handle).
+ */
+int runClient(const char * socketPath, int argc, char ** argv) {
+    char request[REQUEST_MAX];
+    char reply[REPLY_MAX];
+    char resolved[PATH_MAX];
+    struct sockaddr_un addr;
+    unsigned long hits, misses, evictions;
+    size_t used = 0;
+    ssize_t n;
+    int i, fd;
+    char * rest;
+
+    request[0] = '\0';
+    for(i = 0; i < argc; i++) {
+        const char * word = argv[i];
+        if(i > 0 && strcmp(argv[i - 1], "-t") == 0 && realpath(word, resolved)) {
+            word = resolved;
+        }
+        if(strpbrk(word, " \t\n") || strlen(request) + strlen(word) + 2 >= sizeof(request)) {
+            return -1;
+        }
+        strcat(request, word);
+        strcat(request, i + 1 < argc ? " " : "\n");
+    }
+    if(argc == 0 || strlen(socketPath) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+    if(fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if(fd >= 0) close(fd);
+        return -1;
+    }
+    if(write(fd, request, strlen(request)) != (ssize_t)strlen(request)) {
+        close(fd);
+        return -1;
+    }
+    while(used < sizeof(reply) - 1 && (n = read(fd, reply + used, sizeof(reply) - 1 - used)) > 0) {
+        used += n;
+    }
+    reply[used] = '\0';
+    close(fd);
+
+    if(strncmp(reply, "error ", 6) == 0) {
+        printf("%s", reply + 6);
+        exit(-1);
+    }
+    if(strncmp(reply, "ok ", 3) != 0) {
+        return -1;
+    }
+    if(strcmp(argv[0], "stats") == 0) {
+        printf("%s", reply + 3);
+        return 0;
+    }
+    if(sscanf(reply + 3, "%lu %lu %lu", &hits, &misses, &evictions) != 3) {
+        return -1;
+    }
+    printSummary(hits, misses, evictions);
+    rest = strchr(reply, '\n');
+    if(rest) printf("%s", rest + 1);
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * fastpath.c - Specialized kernels for the common cache geometries
+ *
+ * accessCache has to handle every option csim supports. For the plain
+ *  case (one dense cache, bit-slice indexing, write-back and
+ *  write-allocate, no prefetcher or victim cache) with E = 1, 2, 4, 8 or
+ *  16, selectKernel picks a version of the lookup with the number of
+ *  ways fixed at compile time, so the tag search and LRU shuffle unroll
+ *  and nothing is tested per access but the tag. Every other
+ *  configuration keeps the generic code.
+ *
+ * When nothing but such a cache and region counting is switched on,
+ *  parseTraceFile hands the whole trace to runFastTrace, which decodes
+ *  records by hand instead of with sscanf and calls the kernel directly.
+ */
+#include "csim.h"
+
+/*
+ * One access against a set of <ways> lines kept in LRU order, with the
+ *  same results and traffic as accessCache on the same cache.
+ */
+static inline int accessWays(Cache * cache, uint64_t address, int isWrite, const int ways) {
+    uint64_t tag = address >> cache->numBlockBits;
+    Line * set = cache->dense + (tag & (cache->numSets - 1)) * ways;
+    Line used;
+    int i, result = ACCESS_HIT;
+
+    for(i = 0; i < ways; i++) {
+        if(set[i].tag == tag && set[i].state != STATE_I) break;
+    }
+    if(i < ways) {
+        used = set[i];
+        if(isWrite) used.state = STATE_M;
+    }
+    else {
+        result = ACCESS_MISS;
+        for(i = ways - 1; i > 0 && set[i].state != STATE_I; i--) {
+        }
+        if(set[i].state != STATE_I) {
+            i = ways - 1;
+            result |= ACCESS_EVICT;
+            cache->lastVictim = set[i].tag;
+            if(set[i].state == STATE_M) {
+                cache->traffic.dirtyEvictions++;
+                cache->traffic.bytesWritten += cache->blockSize;
+            }
+        }
+        cache->traffic.bytesRead += cache->blockSize;
+        used = set[i];
+        used.tag = tag;
+        used.state = isWrite ? STATE_M : STATE_E;
+        used.stale = 0;
+        used.prefetched = 0;
+    }
+    for(; i > 0; i--) {
+        set[i] = set[i - 1];
+    }
+    set[0] = used;
+    return result;
+}
+
+static int accessWays1(Cache * cache, uint64_t address, int isWrite) {
+    return accessWays(cache, address, isWrite, 1);
+}
+
+static int accessWays2(Cache * cache, uint64_t address, int isWrite) {
+    return accessWays(cache, address, isWrite, 2);
+}
+
+static int accessWays4(Cache * cache, uint64_t address, int isWrite) {
+    return accessWays(cache, address, isWrite, 4);
+}
+
+static int accessWays8(Cache * cache, uint64_t address, int isWrite) {
+    return accessWays(cache, address, isWrite, 8);
+}
+
+static int accessWays16(Cache * cache, uint64_t address, int isWrite) {
+    return accessWays(cache, address, isWrite, 16);
+}
+
+/*
+ * Points cache->kernel at a specialized access function if the cache's
+ *  configuration has one, or leaves it NULL. Call once the cache is fully
+ *  configured.
+ */
+void selectKernel(Cache * cache) {
+    cache->kernel = NULL;
+    if(cache->dense == NULL || cache->indexHash != INDEX_PLAIN || cache->prefetcher ||
+       cache->victimCache || cache->conflict.countSets || cache->writeThrough ||
+       !cache->writeAllocate) {
+        return;
+    }
+    switch(cache->linesPerSet) {
+        case 1: cache->kernel = accessWays1; break;
+        case 2: cache->kernel = accessWays2; break;
+        case 4: cache->kernel = accessWays4; break;
+        case 8: cache->kernel = accessWays8; break;
+        case 16: cache->kernel = accessWays16; break;
+    }
+}
+
+/*
+ * Returns nonzero if the trace only needs the data cache's counts (and
+ *  per-region counts), so runFastTrace can replace the usual loop.
+ */
+int canRunFast(const Sim * sim) {
+    return sim->numCores == 1 && !sim->verbose && !sim->profileOnly && sim->reuse == NULL &&
+           sim->tlbs[0].l1 == NULL && sim->ifetchMode == IFETCH_NONE &&
+           sim->classifier.shadow == NULL && sim->addressMap == NULL &&
+           sim->series == NULL &&
+           sim->caches[0]->kernel != NULL;
+}
+
+static uint64_t parseHex(const char ** p) {
+    uint64_t value = 0;
+    for(;;) {
+        char c = **p;
+        if(c >= '0' && c <= '9') value = (value << 4) | (uint64_t)(c - '0');
+        else if(c >= 'a' && c <= 'f') value = (value << 4) | (uint64_t)(c - 'a' + 10);
+        else if(c >= 'A' && c <= 'F') value = (value << 4) | (uint64_t)(c - 'A' + 10);
+        else return value;
+        (*p)++;
+    }
+}
+
+static void countResult(Stats * st, int result) {
+    st->hits += result & ACCESS_HIT;
+    st->misses += (result & ACCESS_MISS) >> 1;
+    st->evictions += (result & ACCESS_EVICT) >> 2;
+}
+
+/*
+ * The trace loop of parseTraceFile for a sim that passes canRunFast.
+ *  Data records in lackey's exact layout are decoded in place; anything
+ *  else (region records, valgrind's own lines, odd spacing) goes through
+ *  parseTraceLine as usual.
+ *
+ * Params: sim pointer, open trace file.
+ * Returns: 0.
+ */
+int runFastTrace(Sim * sim, FILE * fp) {
+    char buf[256];
+    char label[REGION_LABEL_MAX];
+    TraceRecord rec;
+    Regions * regions = &sim->regions;
+    Cache * cache = sim->caches[0];
+    int (*kernel)(Cache *, uint64_t, int) = cache->kernel;
+    Stats * regionStats = NULL;
+    int result;
+
+    while(fgets(buf, sizeof(buf), fp) != NULL) {
+        const char * p = buf + 3;
+        char op = buf[1];
+        uint64_t address = 0;
+        int decoded = 0;
+
+        if(buf[0] == ' ' && buf[2] == ' ' && (op == 'L' || op == 'S' || op == 'M')) {
+            address = parseHex(&p);
+            decoded = (*p == ',');
+        }
+        if(!decoded) {
+            if(!parseTraceLine(buf, &rec, label) || rec.op == 'I') {
+                continue;
+            }
+            if(rec.op == 'R') {
+                if(rec.size) beginRegion(sim, label);
+                else endRegion(sim);
+                regionStats = regions->current != -1 ? &regions->list[regions->current].stats : NULL;
+                continue;
+            }
+            op = rec.op;
+            address = rec.address;
+        }
+        if(regions->useMarkers && address == regions->markerStart) {
+            beginRegion(sim, NULL);
+            regionStats = &regions->list[regions->current].stats;
+        }
+        result = kernel(cache, address, op == 'S');
+        countResult(&sim->stats, result);
+        if(regionStats) countResult(regionStats, result);
+        if(op == 'M') {
+            result = kernel(cache, address, 1);
+            countResult(&sim->stats, result);
+            if(regionStats) countResult(regionStats, result);
+        }
+        if(regions->useMarkers && address == regions->markerEnd) {
+            endRegion(sim);
+            regionStats = NULL;
+        }
+    }
+    sim->coreStats[0] = sim->stats;
+    return 0;
+}
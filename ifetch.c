@@ -0,0 +1,72 @@
+/*
+ * ifetch.c - Instruction fetch modeling
+ *
+ * lackey writes an "I <addr>,<size>" record for every instruction
+ *  executed. csim-ref skips them, and so does csim unless -I is given:
+ *  split    every core gets its own L1I (geometry from -i, the data
+ *           cache's by default); fetches never touch the data caches
+ *  unified  fetches are loads from the data cache, competing with data
+ *           for the same lines
+ *
+ * An instruction that straddles a block boundary is fetched once per
+ *  block it touches. Fetch results are counted apart from the data
+ *  accesses, so the standard hits/misses/evictions line still describes
+ *  data only; in a unified cache an eviction is charged to whichever
+ *  kind of access caused it.
+ */
+#include "csim.h"
+#include <stdio.h>
+
+static void countResult(Stats * st, int result) {
+    if(result & ACCESS_HIT) st->hits++;
+    if(result & ACCESS_MISS) st->misses++;
+    if(result & ACCESS_EVICT) st->evictions++;
+}
+
+/*
+ * Runs one instruction fetch through the cache that serves it.
+ *
+ * Params: sim pointer, an 'I' record.
+ */
+void simulateFetch(Sim * sim, const TraceRecord * rec) {
+    int core = sim->numCores > 1 ? rec->core : 0;
+    int size = rec->size > 0 ? rec->size : 1;
+    uint64_t block = rec->address >> sim->numBlockBits;
+    uint64_t last = (rec->address + size - 1) >> sim->numBlockBits;
+    int result;
+
+    if(sim->verbose) {
+        if(sim->numCores > 1) printf("I %lx,%d,%d", (unsigned long)rec->address, rec->size, core);
+        else printf("I %lx,%d", (unsigned long)rec->address, rec->size);
+    }
+    for(; block <= last; block++) {
+        uint64_t address = block << sim->numBlockBits;
+        if(sim->ifetchMode == IFETCH_SPLIT) {
+            result = accessCache(sim->icaches[core], address, size, 0);
+        }
+        else if(sim->numCores > 1) {
+            result = coherentAccess(sim, core, address, size, 0);
+        }
+        else {
+            result = accessCache(sim->caches[0], address, size, 0);
+            if(sim->classifier.shadow) {
+                classifyAccess(sim, address, size, 0, result);
+            }
+        }
+        countResult(&sim->ifetchStats, result);
+        if(sim->regions.current != -1) {
+            countResult(&sim->regions.list[sim->regions.current].ifetch, result);
+        }
+        if(sim->verbose) {
+            if(result & ACCESS_HIT) printf(" hit");
+            if(result & ACCESS_MISS) printf(" miss");
+            if(result & ACCESS_EVICT) printf(" eviction");
+        }
+    }
+    if(sim->verbose) printf("\n");
+}
+
+void printFetchSummary(Sim * sim) {
+    printf("ifetch_hits:%lu ifetch_misses:%lu ifetch_evictions:%lu\n",
+           sim->ifetchStats.hits, sim->ifetchStats.misses, sim->ifetchStats.evictions);
+}
@@ -0,0 +1,253 @@
+/*
+ * prefetch.c - Hardware prefetcher models for the single-core cache
+ *
+ * Three prefetchers are modeled, selected with csim -f:
+ *  next    on a miss (or the first use of a prefetched line) fetch the
+ *          <degree> blocks starting <distance> blocks ahead
+ *  stride  per 4KB region, remember the last block and stride; once the
+ *          same stride is seen twice, fetch <degree> blocks along it,
+ *          starting <distance> strides ahead
+ *  stream  a miss allocates one of a few stream buffers, which keeps the
+ *          next <degree> blocks (starting <distance> ahead) outside the
+ *          cache until a demand access claims them
+ *
+ * Time is measured in demand accesses. A prefetch issued at clock t
+ *  arrives at t + latency; a demand access that claims it earlier is
+ *  still useful, but is also counted as late.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Creates a prefetcher to attach to a cache.
+ *
+ * Params: PREFETCH_* kind, degree, distance and latency.
+ * Returns: the prefetcher, all tables empty, or NULL if out of memory.
+ */
+Prefetcher * createPrefetcher(int kind, int degree, int distance, int latency) {
+    Prefetcher * pf = calloc(1, sizeof(*pf));
+    if(pf == NULL) {
+        return NULL;
+    }
+    pf->kind = kind;
+    pf->degree = degree;
+    pf->distance = distance;
+    pf->latency = latency;
+    return pf;
+}
+
+/*
+ * Books the eviction of a line. Unused prefetched lines are useless;
+ *  demand lines pushed out by a prefetch go in the pollution filter so a
+ *  later miss on them can be blamed on the prefetcher.
+ *
+ * Params: cache pointer, evicted line, nonzero if a prefetch fill caused it.
+ */
+void prefetchNoteEviction(Cache * cache, const Line * victim, int byPrefetch) {
+    Prefetcher * pf = cache->prefetcher;
+    if(victim->prefetched) {
+        pf->stats.useless++;
+    }
+    else if(byPrefetch) {
+        pf->pollutionFilter[victim->tag & (POLLUTION_FILTER_SIZE - 1)] = victim->tag + 1;
+    }
+}
+
+/*
+ * Called on every demand miss, before the fill.
+ */
+void prefetchNoteMiss(Cache * cache, uint64_t block) {
+    Prefetcher * pf = cache->prefetcher;
+    uint64_t * slot = &pf->pollutionFilter[block & (POLLUTION_FILTER_SIZE - 1)];
+    if(*slot == block + 1) {
+        pf->stats.polluting++;
+        *slot = 0;
+    }
+}
+
+/*
+ * Called on a demand hit, before the line is moved to the MRU position.
+ *
+ * Returns: 1 if this was the first use of a prefetched line, 0 otherwise.
+ */
+int prefetchHit(Cache * cache, Line * line) {
+    Prefetcher * pf = cache->prefetcher;
+    if(!line->prefetched) {
+        return 0;
+    }
+    pf->stats.useful++;
+    if(pf->clock < line->readyAt) {
+        pf->stats.late++;
+    }
+    line->prefetched = 0;
+    return 1;
+}
+
+/*
+ * Fills a block into the cache on behalf of the prefetcher, unless it is
+ *  already resident.
+ */
+static void issuePrefetch(Cache * cache, uint64_t block) {
+    Prefetcher * pf = cache->prefetcher;
+    uint64_t setNum = getSetIndex(cache, block);
+    uint64_t demandVictim = cache->lastVictim;
+    Line victim;
+    Line * line;
+
+    if(findDuplicateTag(cache, block, setNum) != -1) {
+        return;
+    }
+    pf->stats.issued++;
+    cache->traffic.bytesRead += cache->blockSize;
+    if(fillLine(cache, block, setNum, STATE_E, &victim)) {
+        pf->stats.evictions++;
+        prefetchNoteEviction(cache, &victim, 1);
+        cache->lastVictim = demandVictim;   //lastVictim describes demand fills only
+    }
+    line = &getSet(cache, setNum)[0];
+    line->prefetched = 1;
+    line->readyAt = pf->clock + pf->latency;
+}
+
+/*
+ * Tops a stream buffer back up to <degree> outstanding blocks.
+ */
+static void refillStreamBuffer(Cache * cache, StreamBuffer * buf) {
+    Prefetcher * pf = cache->prefetcher;
+    while(buf->count < pf->degree) {
+        int pos = (buf->head + buf->count) % pf->degree;
+        buf->blocks[pos] = buf->nextBlock++;
+        buf->readyAt[pos] = pf->clock + pf->latency;
+        buf->count++;
+        pf->stats.issued++;
+        cache->traffic.bytesRead += cache->blockSize;
+    }
+}
+
+/*
+ * Checks the stream buffers on a demand miss. A match hands the block
+ *  to the cache; anything queued in front of it is thrown away.
+ *
+ * Returns: 1 if a stream buffer held the block, 0 otherwise.
+ */
+int streamBufferLookup(Cache * cache, uint64_t block) {
+    Prefetcher * pf = cache->prefetcher;
+    int i, k;
+    if(pf->kind != PREFETCH_STREAM) {
+        return 0;
+    }
+    for(i = 0; i < NUM_STREAM_BUFFERS; i++) {
+        StreamBuffer * buf = &pf->buffers[i];
+        if(!buf->valid) continue;
+        for(k = 0; k < buf->count; k++) {
+            int pos = (buf->head + k) % pf->degree;
+            if(buf->blocks[pos] == block) {
+                pf->stats.useful++;
+                pf->stats.useless += k;
+                if(pf->clock < buf->readyAt[pos]) {
+                    pf->stats.late++;
+                }
+                buf->head = (pos + 1) % pf->degree;
+                buf->count -= k + 1;
+                buf->lastUse = pf->clock;
+                refillStreamBuffer(cache, buf);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void allocateStreamBuffer(Cache * cache, uint64_t block) {
+    Prefetcher * pf = cache->prefetcher;
+    StreamBuffer * buf = &pf->buffers[0];
+    int i;
+    for(i = 0; i < NUM_STREAM_BUFFERS; i++) {
+        if(!pf->buffers[i].valid) {
+            buf = &pf->buffers[i];
+            break;
+        }
+        if(pf->buffers[i].lastUse < buf->lastUse) {
+            buf = &pf->buffers[i];
+        }
+    }
+    if(buf->valid) {
+        pf->stats.useless += buf->count;
+    }
+    buf->valid = 1;
+    buf->head = 0;
+    buf->count = 0;
+    buf->nextBlock = block + pf->distance;
+    buf->lastUse = pf->clock;
+    refillStreamBuffer(cache, buf);
+}
+
+static void trainStride(Cache * cache, uint64_t block) {
+    Prefetcher * pf = cache->prefetcher;
+    uint64_t region = (block << cache->numBlockBits) >> STRIDE_REGION_BITS;
+    StrideEntry * entry = &pf->strideTable[region % STRIDE_TABLE_SIZE];
+    int64_t delta;
+    int k;
+
+    if(!entry->valid || entry->region != region) {
+        entry->valid = 1;
+        entry->region = region;
+        entry->lastBlock = block;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return;
+    }
+    delta = (int64_t)(block - entry->lastBlock);
+    if(delta == 0) {
+        return;
+    }
+    if(delta == entry->stride) {
+        if(entry->confidence < 3) entry->confidence++;
+    }
+    else {
+        entry->stride = delta;
+        entry->confidence = 0;
+    }
+    entry->lastBlock = block;
+    if(entry->confidence >= 1) {
+        for(k = 0; k < pf->degree; k++) {
+            issuePrefetch(cache, block + entry->stride * (pf->distance + k));
+        }
+    }
+}
+
+/*
+ * Lets the prefetcher see a demand access and issue whatever it decides to.
+ *  Called after the demand access has been handled.
+ *
+ * Params: cache pointer, block address, nonzero if the access missed,
+ *         nonzero if it was the first use of a prefetched line.
+ */
+void prefetchTrain(Cache * cache, uint64_t block, int miss, int firstUse) {
+    Prefetcher * pf = cache->prefetcher;
+    int k;
+    switch(pf->kind) {
+        case PREFETCH_NEXT:
+            if(miss || firstUse) {
+                for(k = 0; k < pf->degree; k++) {
+                    issuePrefetch(cache, block + pf->distance + k);
+                }
+            }
+            break;
+        case PREFETCH_STRIDE:
+            trainStride(cache, block);
+            break;
+        case PREFETCH_STREAM:
+            if(miss) {
+                allocateStreamBuffer(cache, block);
+            }
+            break;
+    }
+}
+
+void printPrefetchSummary(Cache * cache) {
+    PrefetchStats * st = &cache->prefetcher->stats;
+    printf("prefetch_issued:%lu prefetch_useful:%lu prefetch_late:%lu prefetch_useless:%lu prefetch_polluting:%lu prefetch_evictions:%lu\n",
+           st->issued, st->useful, st->late, st->useless, st->polluting, st->evictions);
+}
@@ -0,0 +1,147 @@
+/*
+ * regions.c - Per-region hit/miss/eviction counts from a single pass
+ *
+ * A region begins with an access to the start marker (or an
+ *  "R begin <label>" line) and ends with an access to the end marker (or
+ *  an "R end" line). Marker accesses belong to the region they bound, the
+ *  same as when test-trans cut one trace file per function. Regions
+ *  started by markers are labeled 0, 1, 2, ... in the order they appear,
+ *  which for a tracegen run is the order of func_list.
+ *
+ * With csim -z every cache is emptied when a region begins, so each
+ *  region is simulated from a cold start exactly as a separate run would
+ *  be; otherwise cache state carries over from whatever ran before. The
+ *  same goes for the reuse profiler's memory of earlier blocks.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Reads the two marker addresses tracegen writes to .marker.
+ *
+ * Params: sim pointer, marker file name.
+ * Returns: 0 on success, -1 if the file can't be read.
+ */
+int loadMarkers(Sim * sim, const char * markerFile) {
+    unsigned long long start, end;
+    FILE * fp = fopen(markerFile, "r");
+    if(!fp) {
+        printf("Can't open marker file\n");
+        return -1;
+    }
+    if(fscanf(fp, "%llx %llx", &start, &end) != 2) {
+        printf("Marker file should hold two hex addresses\n");
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    sim->regions.useMarkers = 1;
+    sim->regions.markerStart = start;
+    sim->regions.markerEnd = end;
+    return 0;
+}
+
+/*
+ * Empties every cache the simulation owns, writing back dirty lines.
+ */
+static void flushSim(Sim * sim) {
+    int i;
+    for(i = 0; i < sim->numCores; i++) {
+        if(sim->caches[i]) flushCache(sim->caches[i]);
+        if(sim->icaches[i]) flushCache(sim->icaches[i]);
+        flushTlb(&sim->tlbs[i]);
+    }
+    if(sim->reuse) {
+        resetReuseProfiler(sim->reuse);
+    }
+    if(sim->classifier.shadow) {
+        resetMissClassifier(sim);
+    }
+}
+
+/*
+ * Starts a new region, ending the current one first if there is one.
+ *
+ * Params: sim pointer, label (NULL to number the region instead).
+ */
+void beginRegion(Sim * sim, const char * label) {
+    Regions * r = &sim->regions;
+    Region * region;
+    if(r->current != -1) {
+        endRegion(sim);
+    }
+    if(r->count == r->capacity) {
+        r->capacity = r->capacity ? r->capacity * 2 : 16;
+        r->list = realloc(r->list, r->capacity * sizeof(Region));
+        if(r->list == NULL) {
+            printf("Out of memory in beginRegion\n");
+            exit(-1);
+        }
+    }
+    region = &r->list[r->count];
+    memset(region, 0, sizeof(*region));
+    if(label) {
+        strncpy(region->label, label, REGION_LABEL_MAX - 1);
+    }
+    else {
+        snprintf(region->label, REGION_LABEL_MAX, "%d", r->count);
+    }
+    r->current = r->count++;
+    if(r->flush) {
+        flushSim(sim);
+    }
+}
+
+void endRegion(Sim * sim) {
+    if(sim->series && sim->regions.current != -1) {
+        seriesRegionEnd(sim, &sim->regions.list[sim->regions.current]);
+    }
+    sim->regions.current = -1;
+}
+
+/*
+ * Prints one line per region and writes the same counts to
+ *  .csim_regions ("<label> <hits> <misses> <evictions>" per line) for
+ *  test-trans to pick up. Reuse profiles follow when csim -r is on.
+ */
+void printRegionSummary(Sim * sim) {
+    Regions * r = &sim->regions;
+    int i;
+    FILE * fp = fopen(".csim_regions", "w");
+    if(!fp) {
+        printf("Can't write .csim_regions\n");
+        return;
+    }
+    for(i = 0; i < r->count; i++) {
+        Stats * st = &r->list[i].stats;
+        if(!sim->profileOnly) {
+            printf("region %s: hits:%lu misses:%lu evictions:%lu",
+                   r->list[i].label, st->hits, st->misses, st->evictions);
+            if(sim->ifetchMode != IFETCH_NONE) {
+                Stats * fst = &r->list[i].ifetch;
+                printf(" ifetch_hits:%lu ifetch_misses:%lu ifetch_evictions:%lu",
+                       fst->hits, fst->misses, fst->evictions);
+            }
+            if(sim->tlbEntries[0] > 0) {
+                printf(" page_walks:%lu", r->list[i].pageWalks);
+            }
+            printf("\n");
+        }
+        fprintf(fp, "%s %lu %lu %lu\n", r->list[i].label, st->hits, st->misses, st->evictions);
+        if(sim->reuse) {
+            char prefix[REGION_LABEL_MAX + 16];
+            snprintf(prefix, sizeof(prefix), "region %s: ", r->list[i].label);
+            printReuseHistogram(prefix, &r->list[i].reuse, sim->reuse);
+        }
+    }
+    fclose(fp);
+}
+
+void freeRegions(Sim * sim) {
+    free(sim->regions.list);
+    sim->regions.list = NULL;
+    sim->regions.count = 0;
+    sim->regions.capacity = 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * reuse.c - Reuse distance and working set profiler
+ *
+ * The reuse (LRU stack) distance of an access is the number of distinct
+ *  blocks touched since the previous access to the same block. A fully
+ *  associative LRU cache of C lines hits exactly the accesses with a
+ *  distance below C, so one histogram answers "how big must the cache
+ *  (or tile) be" for every size at once.
+ *
+ * The working set at an access is the number of distinct blocks touched
+ *  in the <window> accesses ending there. Both come from the same Fenwick
+ *  tree: each block keeps a single mark at the position of its latest
+ *  access, so counting marks over a range of positions counts blocks.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void * checkedRealloc(void * p, size_t size) {
+    p = realloc(p, size);
+    if(p == NULL) {
+        printf("Out of memory in reuse profiler\n");
+        exit(-1);
+    }
+    return p;
+}
+
+static void treeAdd(ReuseProfiler * rp, size_t pos, int delta) {
+    size_t i;
+    for(i = pos + 1; i <= rp->capacity; i += i & (~i + 1)) {
+        rp->tree[i] += delta;
+    }
+}
+
+/*
+ * Returns the number of marks at positions 0 through pos.
+ */
+static unsigned long treePrefix(ReuseProfiler * rp, size_t pos) {
+    unsigned long sum = 0;
+    size_t i;
+    for(i = pos + 1; i > 0; i -= i & (~i + 1)) {
+        sum += rp->tree[i];
+    }
+    return sum;
+}
+
+static void allocateArrays(ReuseProfiler * rp) {
+    rp->tree = checkedRealloc(rp->tree, (rp->capacity + 1) * sizeof(uint32_t));
+    rp->live = checkedRealloc(rp->live, rp->capacity);
+    rp->blockAt = checkedRealloc(rp->blockAt, rp->capacity * sizeof(uint64_t));
+    rp->timeAt = checkedRealloc(rp->timeAt, rp->capacity * sizeof(unsigned long));
+}
+
+/*
+ * Creates a profiler.
+ *
+ * Params: block offset bits, working set window in accesses (0 for none).
+ */
+ReuseProfiler * createReuseProfiler(int numBlockBits, unsigned long window) {
+    ReuseProfiler * rp = calloc(1, sizeof(*rp));
+    if(rp == NULL) {
+        printf("Out of memory in createReuseProfiler\n");
+        exit(-1);
+    }
+    rp->numBlockBits = numBlockBits;
+    rp->window = window;
+    rp->capacity = 1024;
+    allocateArrays(rp);
+    memset(rp->tree, 0, (rp->capacity + 1) * sizeof(uint32_t));
+    memset(rp->live, 0, rp->capacity);
+    blockMapInit(&rp->lastPos, 1024);
+    return rp;
+}
+
+/*
+ * Forgets every block seen so far, as if the trace started over. The
+ *  histograms are kept.
+ */
+void resetReuseProfiler(ReuseProfiler * rp) {
+    blockMapFree(&rp->lastPos);
+    blockMapInit(&rp->lastPos, 1024);
+    memset(rp->tree, 0, (rp->capacity + 1) * sizeof(uint32_t));
+    memset(rp->live, 0, rp->capacity);
+    rp->next = 0;
+}
+
+void freeReuseProfiler(ReuseProfiler * rp) {
+    if(rp == NULL) return;
+    blockMapFree(&rp->lastPos);
+    free(rp->tree);
+    free(rp->live);
+    free(rp->blockAt);
+    free(rp->timeAt);
+    free(rp);
+}
+
+/*
+ * Runs out of positions: squeezes the live marks down to the front,
+ *  keeping their order, and grows the arrays if more than half of them
+ *  would still be in use.
+ */
+static void compactPositions(ReuseProfiler * rp) {
+    size_t pos, k = 0;
+    if(rp->lastPos.count * 2 > rp->capacity) {
+        rp->capacity *= 2;
+        allocateArrays(rp);
+    }
+    for(pos = 0; pos < rp->next; pos++) {
+        if(rp->live[pos]) {
+            rp->blockAt[k] = rp->blockAt[pos];
+            rp->timeAt[k] = rp->timeAt[pos];
+            rp->live[k] = 1;
+            *blockMapFind(&rp->lastPos, rp->blockAt[k]) = k;
+            k++;
+        }
+    }
+    rp->next = k;
+    memset(rp->live + k, 0, rp->capacity - k);
+    memset(rp->tree, 0, (rp->capacity + 1) * sizeof(uint32_t));
+    for(pos = 0; pos < k; pos++) {
+        treeAdd(rp, pos, 1);
+    }
+}
+
+static int bucketOf(unsigned long distance) {
+    int bucket = 0;
+    while(distance > 0 && bucket < REUSE_BUCKETS - 1) {
+        distance >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * Returns the number of distinct blocks touched in the last <window>
+ *  accesses, found by binary searching the first position inside the
+ *  window (access numbers increase with position).
+ */
+static unsigned long workingSet(ReuseProfiler * rp) {
+    size_t lo = 0, hi = rp->next;
+    unsigned long first = rp->time >= rp->window ? rp->time - rp->window + 1 : 0;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if(rp->timeAt[mid] < first) lo = mid + 1;
+        else hi = mid;
+    }
+    return rp->lastPos.count - (lo > 0 ? treePrefix(rp, lo - 1) : 0);
+}
+
+static void record(ReuseHistogram * hist, int cold, int bucket, unsigned long ws, int sampleWs) {
+    if(cold) hist->cold++;
+    else hist->buckets[bucket]++;
+    if(sampleWs) {
+        hist->wsSamples++;
+        hist->wsSum += ws;
+        if(ws > hist->wsMax) hist->wsMax = ws;
+    }
+}
+
+/*
+ * Profiles one data access, adding it to the whole-trace histogram and
+ *  to the current region's.
+ *
+ * Params: sim pointer, address.
+ */
+void reuseAccess(Sim * sim, uint64_t address) {
+    ReuseProfiler * rp = sim->reuse;
+    uint64_t block = address >> rp->numBlockBits;
+    int created, bucket = 0;
+    unsigned long ws = 0;
+    size_t * slot;
+
+    if(rp->next == rp->capacity) {
+        compactPositions(rp);
+    }
+    slot = blockMapInsert(&rp->lastPos, block, &created);
+    if(!created) {
+        //marks after the old position are the distinct blocks seen since
+        unsigned long distance = rp->lastPos.count - treePrefix(rp, *slot);
+        bucket = bucketOf(distance);
+        rp->live[*slot] = 0;
+        treeAdd(rp, *slot, -1);
+    }
+    *slot = rp->next;
+    rp->live[rp->next] = 1;
+    rp->blockAt[rp->next] = block;
+    rp->timeAt[rp->next] = ++rp->time;
+    treeAdd(rp, rp->next, 1);
+    rp->next++;
+
+    if(rp->window) {
+        ws = workingSet(rp);
+    }
+    record(&rp->total, created, bucket, ws, rp->window != 0);
+    if(sim->regions.current != -1) {
+        record(&sim->regions.list[sim->regions.current].reuse, created, bucket, ws, rp->window != 0);
+    }
+}
+
+/*
+ * Prints a histogram on two lines: the reuse distances, as
+ *  "<low>-<high>:<count>" buckets in blocks, and the working set summary.
+ *
+ * Params: label to start the lines with, histogram, profiler it came from.
+ */
+void printReuseHistogram(const char * label, const ReuseHistogram * hist, const ReuseProfiler * rp) {
+    int i, last = -1;
+    for(i = 0; i < REUSE_BUCKETS; i++) {
+        if(hist->buckets[i]) last = i;
+    }
+    printf("%sreuse_distance (%d byte blocks): cold:%lu", label, 1 << rp->numBlockBits, hist->cold);
+    for(i = 0; i <= last; i++) {
+        unsigned long low = i == 0 ? 0 : 1UL << (i - 1);
+        unsigned long high = i == 0 ? 0 : (1UL << i) - 1;
+        if(low == high) printf(" %lu:%lu", low, hist->buckets[i]);
+        else printf(" %lu-%lu:%lu", low, high, hist->buckets[i]);
+    }
+    printf("\n");
+    if(rp->window && hist->wsSamples) {
+        printf("%sworking_set (window %lu): mean_blocks:%.1f max_blocks:%lu max_bytes:%lu\n",
+               label, rp->window, hist->wsSum / hist->wsSamples, hist->wsMax,
+               hist->wsMax << rp->numBlockBits);
+    }
+}
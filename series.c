@@ -0,0 +1,204 @@
+/*
+ * series.c - Windowed time series and phase detection
+ *
+ * csim -o <file> writes one row per window of -W <n> data accesses
+ *  (default 10000), or with -W region one row per region. A file name
+ *  ending in .json gets JSON Lines, one object per row; anything else
+ *  gets CSV with a header; "-" writes to stdout. Rows are written as they
+ *  complete, so memory use doesn't grow with the trace.
+ *
+ * With -p <lambda> each row's miss rate also feeds a two-sided
+ *  Page-Hinkley test: the running sums of the rate's deviation from its
+ *  mean since the last change are tracked in both directions, and once
+ *  either drifts more than lambda from its extreme a new phase starts.
+ *  Every row carries the number of the phase it belongs to.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Opens the sink and writes the CSV header.
+ *
+ * Params: file name ("-" for stdout), accesses per row (0 for regions),
+ *         detection threshold (0 for no detection).
+ * Returns: the series, or NULL if the file can't be written.
+ */
+Series * openSeries(const char * path, unsigned long window, double lambda) {
+    Series * series;
+    size_t len = strlen(path);
+    FILE * fp = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+
+    if(!fp) {
+        printf("Can't write time series file\n");
+        return NULL;
+    }
+    series = calloc(1, sizeof(*series));
+    if(series == NULL) {
+        printf("Out of memory in openSeries\n");
+        exit(-1);
+    }
+    series->out = fp;
+    series->json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    series->window = window;
+    series->lambda = lambda;
+    series->delta = lambda / 10;
+    if(!series->json) {
+        fprintf(fp, "window,first_access,accesses,hits,misses,evictions,miss_rate,region,phase\n");
+    }
+    return series;
+}
+
+static void resetDetector(Series * series) {
+    series->samples = 0;
+    series->mean = 0;
+    series->upSum = series->upMin = 0;
+    series->downSum = series->downMax = 0;
+}
+
+/*
+ * Feeds one miss rate to the Page-Hinkley test.
+ *
+ * Returns: 1 if it starts a new phase, 0 otherwise.
+ */
+static int detectChange(Series * series, double rate) {
+    series->samples++;
+    series->mean += (rate - series->mean) / series->samples;
+    series->upSum += rate - series->mean - series->delta;
+    if(series->upSum < series->upMin) series->upMin = series->upSum;
+    series->downSum += rate - series->mean + series->delta;
+    if(series->downSum > series->downMax) series->downMax = series->downSum;
+    if(series->upSum - series->upMin > series->lambda ||
+       series->downMax - series->downSum > series->lambda) {
+        //the row that tripped the test usually straddles both phases,
+        //so the new phase's mean starts from the next row
+        resetDetector(series);
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Writes a region label as a JSON string, escaping quotes, backslashes
+ *  and control characters.
+ */
+static void writeJsonString(FILE * fp, const char * s) {
+    fputc('"', fp);
+    for(; *s; s++) {
+        if(*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+        else if((unsigned char)*s < 0x20) fprintf(fp, "\\u%04x", (unsigned char)*s);
+        else fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * Writes a region label as a CSV field, quoted (with quotes doubled) if
+ *  it holds a comma or a quote.
+ */
+static void writeCsvField(FILE * fp, const char * s) {
+    if(strpbrk(s, ",\"") == NULL) {
+        fputs(s, fp);
+        return;
+    }
+    fputc('"', fp);
+    for(; *s; s++) {
+        if(*s == '"') fputc('"', fp);
+        fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+static void writeRow(Series * series, const Stats * st, const char * region) {
+    unsigned long accesses = st->hits + st->misses;
+    double rate = accesses ? (double)st->misses / accesses : 0;
+
+    if(accesses == 0) {
+        return;
+    }
+    if(series->lambda > 0 && detectChange(series, rate)) {
+        series->phase++;
+        series->changes++;
+    }
+    if(series->json) {
+        fprintf(series->out, "{\"window\":%lu,\"first_access\":%lu,\"accesses\":%lu,\"hits\":%lu,"
+                "\"misses\":%lu,\"evictions\":%lu,\"miss_rate\":%.6f,\"region\":",
+                series->rows, series->startAccess, accesses, st->hits, st->misses,
+                st->evictions, rate);
+        writeJsonString(series->out, region);
+        fprintf(series->out, ",\"phase\":%d}\n", series->phase);
+    }
+    else {
+        fprintf(series->out, "%lu,%lu,%lu,%lu,%lu,%lu,%.6f,", series->rows,
+                series->startAccess, accesses, st->hits, st->misses, st->evictions, rate);
+        writeCsvField(series->out, region);
+        fprintf(series->out, ",%d\n", series->phase);
+    }
+    series->rows++;
+}
+
+/*
+ * Ends the current window: writes the counts since it began.
+ */
+static void endWindow(Sim * sim) {
+    Series * series = sim->series;
+    Stats delta;
+    const char * region = "";
+    delta.hits = sim->stats.hits - series->start.hits;
+    delta.misses = sim->stats.misses - series->start.misses;
+    delta.evictions = sim->stats.evictions - series->start.evictions;
+    if(sim->regions.current != -1) {
+        region = sim->regions.list[sim->regions.current].label;
+    }
+    writeRow(series, &delta, region);
+    series->start = sim->stats;
+    series->startAccess = series->accesses;
+}
+
+/*
+ * Called after every data access has been counted.
+ */
+void seriesAccess(Sim * sim) {
+    Series * series = sim->series;
+    series->accesses++;
+    if(series->window && series->accesses - series->startAccess >= series->window) {
+        endWindow(sim);
+    }
+}
+
+/*
+ * Called as a region ends; writes its row when rows are per region.
+ */
+void seriesRegionEnd(Sim * sim, const Region * region) {
+    Series * series = sim->series;
+    if(series->window == 0) {
+        //a region's accesses are contiguous, so it began this many accesses ago
+        series->startAccess = series->accesses - region->stats.hits - region->stats.misses;
+        writeRow(series, &region->stats, region->label);
+    }
+}
+
+/*
+ * Writes the last, partial window, prints the phase count when
+ *  detection is on, and closes the sink.
+ */
+void closeSeries(Sim * sim) {
+    Series * series = sim->series;
+    if(series == NULL) return;
+    if(series->window) {
+        endWindow(sim);
+    }
+    else if(sim->regions.current != -1) {
+        seriesRegionEnd(sim, &sim->regions.list[sim->regions.current]);
+    }
+    if(series->lambda > 0) {
+        printf("series_rows:%lu phases:%d phase_changes:%lu\n", series->rows, series->phase + 1,
+               series->changes);
+    }
+    if(series->out != stdout) {
+        fclose(series->out);
+    }
+    free(series);
+    sim->series = NULL;
+}
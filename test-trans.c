@@ -43,109 +43,95 @@ static struct results results = {-1, 0, INT_MAX};
 
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
+ *
+ * tracegen runs every registered function under valgrind once, with a
+ * pair of marker accesses around each one. csim then simulates the whole
+ * trace in a single pass, keeping separate counts for each marked region
+ * and starting each region with an empty cache.
  */
 void eval_perf(unsigned int s, unsigned int E, unsigned int b)
 {
-    int i,flag;
+    int i,flag,valid;
     unsigned int len, hits, misses, evictions;
     unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
+    char buf[1000], cmd[255], label[64];
 
     registerFunctions(); 
 
     /* Open the complete trace file */
     FILE* full_trace_fp;  
-    FILE* part_trace_fp; 
-
-    /* Evaluate the performance of each registered transpose function */
+    FILE* all_trace_fp; 
+
+    printf("\nStep 1: Validating and generating memory traces for %d functions\n", func_counter);
+    /* Use valgrind to generate the trace */
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d  > trace.tmp", M, N);
+    flag=WEXITSTATUS(system(cmd));
+    if (0!=flag) {
+        printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\n",flag-1,M,N,flag-1);
+    }
 
+    /* Get the start and end marker addresses, then which functions passed */
+    FILE* marker_fp = fopen(".marker", "r");
+    assert(marker_fp);
+    fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
     for (i=0; i<func_counter; i++) {
-        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 )
+        if (fscanf(marker_fp, "%d", &valid) != 1)
+            valid = 0;
+        func_list[i].correct = valid;
+        if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0 ) {
             results.funcid = i; /* remember which function is the submission */
-
-
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n",i,func_counter);
-        /* Use valgrind to generate the trace */
-
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N,i);
-        flag=WEXITSTATUS(system(cmd));
-        if (0!=flag) {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n",flag-1,M,N,i);      
-            continue;
-        }
-
-        /* Get the start and end marker addresses */
-        FILE* marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
-
-
-        func_list[i].correct=1;
-
-        /* Save the correctness of the transpose submission */
-        if (results.funcid == i ) {
-            results.correct = 1;
+            results.correct = valid;
         }
-
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
-
-
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
-    
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL) {
-
-            /* We are only interested in memory access instructions */
-            if (buf[0]==' ' && buf[2]==' ' &&
-                (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
-                sscanf(buf+3, "%llx,%u", &addr, &len);
-        
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff) {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end) {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
+    }
+    fclose(marker_fp);
+
+    full_trace_fp = fopen("trace.tmp", "r");
+    assert(full_trace_fp);
+    all_trace_fp = fopen("trace.all", "w");
+    assert(all_trace_fp);
+
+    /* Keep every memory access made by the program itself */
+    while (fgets(buf, 1000, full_trace_fp) != NULL) {
+
+        /* We are only interested in memory access instructions */
+        if (buf[0]==' ' && buf[2]==' ' &&
+            (buf[1]=='S' || buf[1]=='M' || buf[1]=='L' )) {
+            sscanf(buf+3, "%llx,%u", &addr, &len);
+
+            /* Valgrind creates many spurious accesses to the
+               stack that have nothing to do with the students
+               code. At the moment, we are ignoring all stack
+               accesses by using the simple filter of recording
+               accesses to only the low 32-bit portion of the
+               address space. At some point it would be nice to
+               try to do more informed filtering so that would
+               eliminate the valgrind stack references while
+               include the student stack references. */
+            if (addr < 0xffffffff) {
+                fputs(buf, all_trace_fp);
             }
         }
-        fclose(full_trace_fp);
-
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null", 
-                s, E, b, i);
-        system(cmd);
-    
-        /* Collect results from the reference simulator */
-        FILE* in_fp = fopen(".csim_results","r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
+    }
+    fclose(full_trace_fp);
+    fclose(all_trace_fp);
+
+    /* Run the simulator once, one region per function */
+    printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+    sprintf(cmd, "./csim -s %u -E %u -b %u -m .marker -z -t trace.all > /dev/null", 
+            s, E, b);
+    system(cmd);
+
+    /* Collect per-region results from the simulator */
+    FILE* in_fp = fopen(".csim_regions","r");
+    assert(in_fp);
+    for (i=0; i<func_counter; i++) {
+        if (fscanf(in_fp, "%63s %u %u %u", label, &hits, &misses, &evictions) != 4)
+            break;
+        if (!func_list[i].correct) {
+            printf("func %u (%s): failed validation, skipping performance evaluation\n",
+                   i, func_list[i].description);
+            continue;
+        }
         func_list[i].num_hits = hits;
         func_list[i].num_misses = misses;
         func_list[i].num_evictions = evictions;
@@ -157,7 +143,7 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
             results.misses = misses;
         }
     }
-  
+    fclose(in_fp);
 }
 
 /*
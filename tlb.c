@@ -0,0 +1,114 @@
+/*
+ * tlb.c - Data TLB and page walk model (csim -T, -P)
+ *
+ * Every data access is translated before it reaches the cache. Each core
+ *  has a private L1 TLB and optionally a larger L2 TLB behind it; both
+ *  are Caches with a page as the block, so an entry is a line and the
+ *  usual set lookup and LRU order apply. A miss in every level is a page
+ *  walk, which fills both levels and costs one page table reference per
+ *  level of the radix tree (4 with 4KB pages, 3 with 2MB, 2 with 1GB).
+ *
+ * Page walks do not go through the simulated data cache.
+ */
+#include "csim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static int walkLevels(int pageBits) {
+    if(pageBits == PAGE_BITS_1G) return 2;
+    if(pageBits == PAGE_BITS_2M) return 3;
+    return 4;
+}
+
+/*
+ * Creates one TLB level. parseCommandLine has checked that entries / ways
+ *  is a power of two.
+ */
+static Cache * createTlbLevel(Sim * sim, int level) {
+    int setBits = 0;
+    Cache * tlb;
+    while((1 << setBits) < sim->tlbEntries[level] / sim->tlbWays[level]) {
+        setBits++;
+    }
+    tlb = createCache(setBits, sim->tlbWays[level], sim->pageBits);
+    if(tlb == NULL) {
+        printf("Out of memory creating TLB\n");
+        exit(-1);
+    }
+    selectKernel(tlb);
+    return tlb;
+}
+
+/*
+ * Gives every simulated core its TLBs, as configured in the sim.
+ */
+void createTlbs(Sim * sim) {
+    int i;
+    for(i = 0; i < sim->numCores; i++) {
+        sim->tlbs[i].l1 = createTlbLevel(sim, 0);
+        if(sim->tlbEntries[1] > 0) {
+            sim->tlbs[i].l2 = createTlbLevel(sim, 1);
+        }
+    }
+}
+
+/*
+ * Translates one data address for a core.
+ *
+ * Params: sim pointer, core, virtual address.
+ * Returns: TLB_L1_HIT, TLB_L2_HIT or TLB_WALK.
+ */
+int translate(Sim * sim, int core, uint64_t address) {
+    Tlb * tlb = &sim->tlbs[core];
+    if(accessCache(tlb->l1, address, 1, 0) & ACCESS_HIT) {
+        tlb->l1Hits++;
+        return TLB_L1_HIT;
+    }
+    tlb->l1Misses++;
+    if(tlb->l2 && (accessCache(tlb->l2, address, 1, 0) & ACCESS_HIT)) {
+        tlb->l2Hits++;
+        return TLB_L2_HIT;
+    }
+    tlb->walks++;
+    tlb->walkRefs += walkLevels(sim->pageBits);
+    if(sim->regions.current != -1) {
+        sim->regions.list[sim->regions.current].pageWalks++;
+    }
+    return TLB_WALK;
+}
+
+void flushTlb(Tlb * tlb) {
+    if(tlb->l1) flushCache(tlb->l1);
+    if(tlb->l2) flushCache(tlb->l2);
+}
+
+/*
+ * Prints the TLB counts summed over every core.
+ */
+void printTlbSummary(Sim * sim) {
+    Tlb total = {0};
+    int i;
+    for(i = 0; i < sim->numCores; i++) {
+        total.l1Hits += sim->tlbs[i].l1Hits;
+        total.l1Misses += sim->tlbs[i].l1Misses;
+        total.l2Hits += sim->tlbs[i].l2Hits;
+        total.walks += sim->tlbs[i].walks;
+        total.walkRefs += sim->tlbs[i].walkRefs;
+    }
+    printf("page_size:%lu tlb_l1_hits:%lu tlb_l1_misses:%lu", 1UL << sim->pageBits,
+           total.l1Hits, total.l1Misses);
+    if(sim->tlbEntries[1] > 0) {
+        printf(" tlb_l2_hits:%lu", total.l2Hits);
+    }
+    printf(" page_walks:%lu walk_refs:%lu\n", total.walks, total.walkRefs);
+}
+
+void freeTlbs(Sim * sim) {
+    int i;
+    for(i = 0; i < sim->numCores; i++) {
+        freeCache(sim->tlbs[i].l1);
+        freeCache(sim->tlbs[i].l2);
+        sim->tlbs[i].l1 = NULL;
+        sim->tlbs[i].l2 = NULL;
+    }
+}
@@ -4,7 +4,16 @@
  * 
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use. When every function is
+ * traced in one run, the file also gets a second line with a 1 or 0 per
+ * function saying whether it produced a correct transpose.
+ *
+ * With -T <threads>, tracegen instead writes a multi-threaded trace of
+ * the baseline transpose straight to stdout, one core id per record, for
+ * use with csim -c.
+ *
+ * Both modes also write .addrmap, giving the base address and shape of
+ * A and B so that csim -A can charge misses to matrix elements.
  */
 
 #include <stdlib.h>
@@ -46,12 +55,59 @@ int validate(int fn,int M, int N, int A[N][M], int B[M][N]) {
     return 1;
 }
 
+/*
+ * writeAddressMap - Records where A (N rows of M ints) and B (M rows of
+ *     N ints) live, one "name base rows cols elemsize" line each.
+ */
+void writeAddressMap() {
+    FILE* map_fp = fopen(".addrmap","w");
+    assert(map_fp);
+    fprintf(map_fp, "A %llx %d %d %d\n", (unsigned long long int) A, N, M, (int) sizeof(int));
+    fprintf(map_fp, "B %llx %d %d %d\n", (unsigned long long int) B, M, N, (int) sizeof(int));
+    fclose(map_fp);
+}
+
+/*
+ * emitParallelTrace - Writes the trace of the row-wise transpose with the
+ *     rows of A dealt out to nthreads threads in chunks of chunk rows. The
+ *     threads are interleaved one element at a time, as if each ran on
+ *     its own core in lockstep, and every record names its thread as the
+ *     trailing core field. Small chunks put neighbouring elements of each
+ *     row of B on different threads.
+ */
+void emitParallelTrace(int nthreads, int chunk) {
+    int t, k, emitted;
+    char *a = (char *) A;
+    char *b = (char *) B;
+
+    for (k = 0; ; k++) {
+        emitted = 0;
+        for (t = 0; t < nthreads; t++) {
+            /* k-th element handled by thread t */
+            int n = k / M;
+            int row = ((n / chunk) * nthreads + t) * chunk + n % chunk;
+            int col = k % M;
+            if (row >= N)
+                continue;
+            printf(" L %llx,4,%d\n",
+                   (unsigned long long int) (a + ((long) row * M + col) * sizeof(int)), t);
+            printf(" S %llx,4,%d\n",
+                   (unsigned long long int) (b + ((long) col * N + row) * sizeof(int)), t);
+            emitted = 1;
+        }
+        if (!emitted)
+            break;
+    }
+}
+
 int main(int argc, char* argv[]){
     int i;
 
     char c;
     int selectedFunc=-1;
-    while( (c=getopt(argc,argv,"M:N:F:")) != -1){
+    int threads=0;
+    int chunk=1;
+    while( (c=getopt(argc,argv,"M:N:F:T:C:")) != -1){
         switch(c){
         case 'M':
             M = atoi(optarg);
@@ -62,13 +118,28 @@ int main(int argc, char* argv[]){
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'T':
+            threads = atoi(optarg);
+            break;
+        case 'C':
+            chunk = atoi(optarg);
+            break;
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
             exit(1);
         }
     }
-  
+
+    if (threads > 0) {
+        if (M <= 0 || N <= 0 || M > 256 || N > 256 || chunk <= 0) {
+            printf("./tracegen needs -M and -N (at most 256) and a positive -C with -T.\n");
+            exit(1);
+        }
+        writeAddressMap();
+        emitParallelTrace(threads, chunk);
+        return 0;
+    }
 
     /*  Register transpose functions */
     registerFunctions();
@@ -83,16 +154,32 @@ int main(int argc, char* argv[]){
             (unsigned long long int) &MARKER_START,
             (unsigned long long int) &MARKER_END );
     fclose(marker_fp);
+    writeAddressMap();
 
     if (-1==selectedFunc) {
-        /* Invoke registered transpose functions */
+        /* Invoke registered transpose functions, carrying on past
+           failures so every function gets its own marked region */
+        int failed = 0;
         for (i=0; i < func_counter; i++) {
+            /* Refill B so a function can't pass on the previous one's
+               output; this stays outside the marked region */
+            randMatrix(N, M, B);
             MARKER_START = 33;
             (*func_list[i].func_ptr)(M, N, A, B);
             MARKER_END = 34;
-            if (!validate(i,M,N,A,B))
-                return i+1;
+            func_list[i].correct = validate(i,M,N,A,B);
+            if (!func_list[i].correct && !failed)
+                failed = i+1;
         }
+
+        /* Record which functions passed validation */
+        marker_fp = fopen(".marker","a");
+        assert(marker_fp);
+        fprintf(marker_fp, "\n");
+        for (i=0; i < func_counter; i++)
+            fprintf(marker_fp, "%d ", func_list[i].correct);
+        fclose(marker_fp);
+        return failed;
     } else {
         MARKER_START = 33;
         (*func_list[selectedFunc].func_ptr)(M, N, A, B);